@@ -0,0 +1,22 @@
+;; Symbolic derivative, quoted lists and map (Gabriel)
+;; expect: 60
+(define leaves '(x a b 3 5))
+(define (deriv a)
+  (cond ((memq a leaves) (if (eq? a 'x) 1 0))
+        ((eq? (car a) '+) (cons '+ (map deriv (cdr a))))
+        ((eq? (car a) '-) (cons '- (map deriv (cdr a))))
+        ((eq? (car a) '*)
+         (list '* a (cons '+ (map (lambda (a) (list '/ (deriv a) a)) (cdr a)))))
+        (else 'error)))
+(define (nodes tree) ;Conses in tree, its leaves are not pairs
+  (if (null? tree)
+      0
+      (if (memq tree leaves)
+          0
+          (if (memq tree '(+ - * / 0 1))
+              0
+              (+ 1 (nodes (car tree)) (nodes (cdr tree)))))))
+(define expression '(+ (* 3 x x) (* a x x) (* b x) 5))
+(define (run n result)
+  (if (= n 0) result (run (- n 1) (deriv expression))))
+(nodes (run 30000 '()))
@@ -0,0 +1,46 @@
+;; Destructive list operations, set-car! and set-cdr! on reused cells (Gabriel)
+;; expect: 10
+(define (make-nils n)
+  (let loop ((i n) (a '()))
+    (if (= i 0) a (loop (- i 1) (cons '() a)))))
+(define (append! x y)
+  (let loop ((a x))
+    (if (null? (cdr a))
+        (begin (set-cdr! a y) x)
+        (loop (cdr a)))))
+(define (grow! l m) ;Every sublist gets m more elements
+  (if (null? l)
+      #t
+      (begin
+        (if (null? (car l)) (set-car! l (cons '() '())))
+        (append! (car l) (make-nils m))
+        (grow! (cdr l) m))))
+(define (head! lst n i) ;Sets the n first cars to i, returns the rest
+  (if (= n 0)
+      lst
+      (begin (set-car! lst i) (head! (cdr lst) (- n 1) i))))
+(define (cut! l1 i) ;Sets the first half of (car l1) to i and cuts it off
+  (let ((n (/ (length (car l1)) 2)))
+    (if (= n 0)
+        (begin (set-car! l1 '()) (car l1))
+        (let ((a (head! (car l1) (- n 1) i)))
+          (let ((x (cdr a)))
+            (set-cdr! a '())
+            x)))))
+(define (shift! l1 l2 i) ;Each sublist keeps half of itself and takes the tail of the previous one
+  (if (null? l2)
+      #t
+      (let ((a (head! (car l2) (/ (length (car l2)) 2) i)))
+        (set-cdr! a (cut! l1 i))
+        (shift! (cdr l1) (cdr l2) i))))
+(define (destructive n m)
+  (let ((l (make-nils 10)))
+    (let loop ((i n))
+      (if (= i 0)
+          l
+          (begin
+            (if (null? (car l))
+                (grow! l m)
+                (shift! l (cdr l) i))
+            (loop (- i 1)))))))
+(length (destructive 6000 50))
@@ -0,0 +1,7 @@
+;; Doubly recursive Fibonacci, arithmetic and calls
+;; expect: 832040
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 30)
@@ -0,0 +1,25 @@
+;; Collector stress: short-lived trees and vectors next to long-lived data (after GCBench)
+;; expect: 16384
+(define (make-tree depth)
+  (if (= depth 0)
+      (cons '() '())
+      (cons (make-tree (- depth 1)) (make-tree (- depth 1)))))
+(define (count tree)
+  (if (null? (car tree))
+      1
+      (+ (count (car tree)) (count (cdr tree)))))
+(define (churn n depth total) ;Leaves of n temporary trees of depth
+  (if (= n 0)
+      total
+      (churn (- n 1) depth (+ total (count (make-tree depth))))))
+(define (blocks n size kept) ;n temporary vectors of size, one in 16 is kept
+  (if (= n 0)
+      (length kept)
+      (let ((block (make-vector size n)))
+        (blocks (- n 1) size (if (= (* (/ n 16) 16) n) (cons block kept) kept)))))
+(define (run long-lived)
+  (churn 200 12 0)
+  (blocks 400 100000 '())
+  (churn 20 14 0)
+  (count long-lived))
+(run (make-tree 14))
@@ -0,0 +1,22 @@
+;; Solutions of the 8 queens problem, list consing and closures (Gabriel)
+;; expect: 92
+(define (iota1 n)
+  (let loop ((i n) (l '()))
+    (if (= i 0) l (loop (- i 1) (cons i l)))))
+(define (ok? row dist placed)
+  (if (null? placed)
+      #t
+      (and (not-equal? (car placed) (+ row dist))
+           (not-equal? (car placed) (- row dist))
+           (ok? row (+ dist 1) (cdr placed)))))
+(define (not-equal? a b) (if (= a b) #f #t))
+(define (try x y z)
+  (if (null? x)
+      (if (null? y) 1 0)
+      (+ (if (ok? (car x) 1 z)
+             (try (append (cdr x) y) '() (cons (car x) z))
+             0)
+         (try (cdr x) (cons (car x) y) z))))
+(define (queens n) (try (iota1 n) '() '()))
+(define (repeat n thunk) (if (= n 1) (thunk) (begin (thunk) (repeat (- n 1) thunk))))
+(repeat 30 (lambda () (queens 8)))
@@ -0,0 +1,93 @@
+#!/bin/sh
+# Builds the interpreter with fixed flags, runs the benchmarks in this directory and prints a
+# tab separated report on stdout, after a "# build:" line with the compiler and flags:
+#   benchmark status wall_ms allocated_cells collections gc_ms [baseline_ms ratio baseline_cells]
+# Usage: bench/run.sh [baseline.tsv]
+# Each benchmark runs BENCH_RUNS times (3), the fastest run is reported. Its last value must
+# match the ";; expect:" line of the file. With a baseline, status is "allocations" when the
+# allocated cells differ, they are deterministic, and "slower" when wall time grew by more
+# than BENCH_TOLERANCE percent (10), as it varies between runs. A baseline built another way
+# is refused, its times do not compare.
+# Exit status is 1 if a benchmark failed, allocated differently or got slower.
+# A new baseline: bench/run.sh > bench/baseline.tsv
+
+baseline=$1
+runs=${BENCH_RUNS:-3}
+tolerance=${BENCH_TOLERANCE:-10}
+dir=$(cd "$(dirname "$0")" && pwd)
+cxx=${CXX:-g++}
+build="$cxx -std=c++17 -O2 -pthread"
+
+if [ -n "$baseline" ] && [ ! -r "$baseline" ]; then
+    echo "usage: $0 [baseline.tsv]" >&2
+    exit 2
+fi
+if [ -n "$baseline" ] && [ "$(sed -n 's/^# build: //p' "$baseline")" != "$build" ]; then
+    echo "$0: $baseline was not built with $build" >&2
+    exit 2
+fi
+
+out=$(mktemp) || exit 2
+errors=$(mktemp) || exit 2
+work=$(mktemp -d) || exit 2
+trap 'rm -rf "$out" "$errors" "$work"' EXIT
+lisp=$work/lisp
+(cd "$dir/.." && $build *.cpp -ldl -rdynamic -o "$lisp") || exit 2
+
+printf '# build: %s\n' "$build"
+printf 'benchmark\tstatus\twall_ms\tallocated_cells\tcollections\tgc_ms'
+[ -n "$baseline" ] && printf '\tbaseline_ms\tratio\tbaseline_cells'
+printf '\n'
+
+failed=0
+for file in "$dir"/*.scm; do
+    name=$(basename "$file" .scm)
+    expected=$(sed -n 's/^;; expect: //p' "$file")
+    status=ok
+    best=
+    run=0
+    while [ $run -lt "$runs" ]; do
+        run=$((run + 1))
+        if ! "$lisp" --statistics < "$file" > "$out" 2> "$errors"; then
+            status=crashed
+            break
+        fi
+        result=$(grep 'LISP REPL>' "$out" | tail -n 2 | head -n 1 | sed 's/^LISP REPL>//')
+        if grep -q 'Runtime error' "$out" || [ "$result" != "$expected" ]; then
+            status=wrong
+            break
+        fi
+        stats=$(tail -n 1 "$errors" | sed 's/wall_ms=\([^ ]*\) allocated_cells=\([^ ]*\) collections=\([^ ]*\) gc_ms=\([^ ]*\)/\1	\2	\3	\4/')
+        if [ -z "$best" ] || awk -v a="${stats%%	*}" -v b="${best%%	*}" 'BEGIN { exit !(a < b) }'; then
+            best=$stats
+        fi
+    done
+    if [ $status != ok ]; then
+        failed=1
+        printf '%s\t%s\t-\t-\t-\t-' "$name" "$status"
+        [ -n "$baseline" ] && printf '\t-\t-\t-'
+        printf '\n'
+        continue
+    fi
+    if [ -z "$baseline" ]; then
+        printf '%s\t%s\t%s\n' "$name" "$status" "$best"
+        continue
+    fi
+    reference=$(awk -F '\t' -v name="$name" '$1 == name && $2 == "ok" { print $3 }' "$baseline")
+    reference_cells=$(awk -F '\t' -v name="$name" '$1 == name && $2 == "ok" { print $4 }' "$baseline")
+    if [ -z "$reference" ]; then
+        printf '%s\t%s\t%s\t-\t-\t-\n' "$name" "$status" "$best"
+        continue
+    fi
+    cells=$(printf '%s' "$best" | cut -f 2)
+    ratio=$(awk -v a="${best%%	*}" -v b="$reference" 'BEGIN { printf "%.3f", (b > 0 ? a / b : 1) }')
+    if [ "$cells" != "$reference_cells" ]; then
+        status=allocations
+        failed=1
+    elif awk -v r="$ratio" -v t="$tolerance" 'BEGIN { exit !(r > 1 + t / 100) }'; then
+        status=slower
+        failed=1
+    fi
+    printf '%s\t%s\t%s\t%s\t%s\t%s\n' "$name" "$status" "$best" "$reference" "$ratio" "$reference_cells"
+done
+exit $failed
@@ -0,0 +1,21 @@
+;; Early exits from a deep search through call/cc, across dynamic-wind
+;; expect: 150000
+(define (make-tree depth)
+  (if (= depth 0)
+      '()
+      (cons (make-tree (- depth 1)) (make-tree (- depth 1)))))
+(define (walk tree visit) ;Calls visit at each leaf, left to right
+  (if (null? tree)
+      (visit)
+      (begin (walk (car tree) visit) (walk (cdr tree) visit))))
+(define (nth-leaf tree n) ;Escapes from the walk at the n-th leaf
+  (call/cc
+   (lambda (return)
+     (let ((count 0))
+       (dynamic-wind
+        (lambda () #t)
+        (lambda () (walk tree (lambda () (set! count (+ count 1)) (if (= count n) (return count) #f))))
+        (lambda () #t))))))
+(define (run tree i total)
+  (if (= i 0) total (run tree (- i 1) (+ total (nth-leaf tree 500)))))
+(run (make-tree 14) 300 0)
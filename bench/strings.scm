@@ -0,0 +1,18 @@
+;; String building: output string ports, string-append, number->string, substring
+;; expect: 155783
+(define (report port i n) ;n lines written to port, then its string
+  (if (= i n)
+      (get-output-string port)
+      (begin
+        (write-string (string-append "line " (number->string i) ": " (symbol->string 'value) "\n") port)
+        (report port (+ i 1) n))))
+(define (concat i acc) ;Quadratic on purpose: each step copies acc
+  (if (= i 0) acc (concat (- i 1) (string-append acc (number->string i)))))
+(define (pieces text i n total) ;Lengths of n substrings of text
+  (if (= i n)
+      total
+      (pieces text (+ i 1) n (+ total (vector-length (substring text i (+ i 100)))))))
+(define (repeat n thunk) (if (= n 1) (thunk) (begin (thunk) (repeat (- n 1) thunk))))
+(define (run text)
+  (+ (vector-length text) (pieces text 0 1000 0) (vector-length (concat 1000 ""))))
+(run (repeat 40 (lambda () (report (open-output-string) 0 3000))))
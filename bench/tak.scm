@@ -0,0 +1,10 @@
+;; Takeuchi function, call-intensive (Gabriel)
+;; expect: 7
+(define (tak x y z)
+  (if (< y x)
+      (tak (tak (- x 1) y z)
+           (tak (- y 1) z x)
+           (tak (- z 1) x y))
+      z))
+(define (repeat n thunk) (if (= n 1) (thunk) (begin (thunk) (repeat (- n 1) thunk))))
+(repeat 30 (lambda () (tak 18 12 6)))
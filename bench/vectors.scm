@@ -0,0 +1,24 @@
+;; Vector fill, indexed access and sorting with < and with a closure
+;; expect: 0
+(define size 20000)
+(define (modulo-of x m) (- x (* (/ x m) m)))
+(define (fill! v i seed) ;Pseudo-random fixnums below 10000
+  (if (= i (vector-length v))
+      v
+      (let ((next (modulo-of (+ (* seed 75) 74) 65537)))
+        (vector-set! v i (modulo-of next 10000))
+        (fill! v (+ i 1) next))))
+(define (out-of-order v i count)
+  (if (= i (- (vector-length v) 1))
+      count
+      (out-of-order v (+ i 1) (if (> (vector-ref v i) (vector-ref v (+ i 1))) (+ count 1) count))))
+(define (sum v i acc) (if (= i (vector-length v)) acc (sum v (+ i 1) (+ acc (vector-ref v i)))))
+(define (check seed) ;0 if both sorts keep the elements and order them
+  (let ((v (fill! (make-vector size 0) 0 seed)))
+    (let ((total (sum v 0 0))
+          (w (sort v (lambda (a b) (< a b)))))
+      (sort! v <)
+      (+ (out-of-order v 0 0) (out-of-order w 0 0) (- (sum v 0 0) total) (- (sum w 0 0) total)))))
+(define (run seed result)
+  (if (= seed 0) result (run (- seed 1) (+ result (check seed)))))
+(run 8 0)
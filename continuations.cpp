@@ -0,0 +1,93 @@
+//Escape continuations and dynamic-wind
+#include "lisp.hpp"
+
+/*
+    The evaluator recurses on the C++ stack, which cannot be captured, so continuations are
+    escapes: (k v) is valid while the call/cc that made k has not returned, in the thread
+    that made it. Nothing is copied. k is a cell (slot . value): slot is the stack index
+    where call/cc keeps k, #f once it returned. Calling k stores the value in the cell and
+    throws continuation_jump, caught by that call/cc only, which cuts the stack back to its
+    slot. Error handlers do not catch it. dynamic-wind runs its after thunk on the way out,
+    for escapes and errors but not interruptions, which an after thunk could otherwise stop.
+    A copy sent to another isolate is dead, so is one from an image: its slot does not hold it.
+*/
+
+struct continuation_jump
+{
+    object_word slot; //As the fixnum in the car of k
+};
+
+bool live_continuationp(lisp_object k) //Its call/cc is running in this thread
+{
+    const lisp_object slot = car(k.id);
+    return typep(slot,fixnum) && slot.id >= stack_base && slot.id < stack_pointer && eq(stack[slot.id],k);
+}
+
+void apply_continuation(unsigned argc) //Args are pushed after unev, as for apply_procedure
+{
+    if(argc > 1)
+        throw SimpleError("continuation: at most one value awaited");
+    if(!live_continuationp(proc))
+        throw SimpleError("continuation: escapes only to a running call/cc of its thread");
+    set_cdr(proc.id,argc ? stack_get(0) : nil);
+    throw continuation_jump{car(proc.id).id};
+}
+
+struct continuation_extent //Kills k when call/cc returns, escapes included
+{
+    const unsigned slot;
+    ~continuation_extent() { set_car(stack[slot].id,val_false); }
+};
+
+void prim_call_cc(unsigned num) //(call/cc procedure) calls it with k
+{
+    if(num != 1)
+        throw SimpleError("call/cc: procedure awaited");
+    const unsigned at = stack_pointer - 1;
+    const lisp_object k = make_obj(continuation,cons(nil,nil).id);
+    set_car(k.id,number(stack_pointer));
+    push(k);
+    continuation_extent extent{stack_pointer - 1};
+    push(unev);
+    push(stack[extent.slot]);
+    try {
+        call_back(at,1);
+    } catch(continuation_jump& jump) {
+        if(jump.slot != extent.slot)
+            throw;
+        stack_set(extent.slot + 1);
+        val = cdr(stack[extent.slot].id);
+        set_cdr(stack[extent.slot].id,nil);
+    }
+    stack_drop(1);
+}
+
+void call_thunk(unsigned at)
+{
+    push(unev);
+    call_back(at,0);
+}
+
+void prim_dynamic_wind(unsigned num) //(dynamic-wind before thunk after)
+{
+    if(num != 3)
+        throw SimpleError("dynamic-wind: before, thunk and after awaited");
+    const unsigned at = stack_pointer - 3;
+    call_thunk(at);
+    try {
+        call_thunk(at + 1);
+    } catch(continuation_jump&) {
+        stack_set(at + 3);
+        call_thunk(at + 2);
+        throw;
+    } catch(interruption&) { //No more user code
+        throw;
+    } catch(SimpleError&) {
+        stack_set(at + 3);
+        call_thunk(at + 2);
+        throw;
+    }
+    push(val);
+    call_thunk(at + 2);
+    pop(val);
+}
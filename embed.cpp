@@ -0,0 +1,149 @@
+//Embedding API, see embed.hpp
+#include <cstring>
+#include "embed.hpp"
+
+//Handles: slots traced as roots, free ones hold nil
+thread_local std::vector<lisp_object> handle_slots;
+thread_local std::vector<unsigned> free_handle_slots;
+
+unsigned take_handle_slot(lisp_object obj)
+{
+    if(free_handle_slots.empty()) {
+        handle_slots.push_back(obj);
+        return handle_slots.size() - 1;
+    }
+    const unsigned slot = free_handle_slots.back();
+    free_handle_slots.pop_back();
+    handle_slots[slot] = obj;
+    return slot;
+}
+
+void gc_trace_handles(void)
+{
+    for(lisp_object& obj : handle_slots)
+        obj = gc_trace(obj);
+}
+
+lisp_handle::lisp_handle(lisp_object obj) : slot(take_handle_slot(obj))
+{
+}
+
+lisp_handle::lisp_handle(const lisp_handle& other) : slot(take_handle_slot(other.get()))
+{
+}
+
+lisp_handle& lisp_handle::operator=(const lisp_handle& other)
+{
+    handle_slots[slot] = other.get();
+    return *this;
+}
+
+lisp_handle::~lisp_handle()
+{
+    handle_slots[slot] = nil;
+    free_handle_slots.push_back(slot);
+}
+
+lisp_object lisp_handle::get(void) const
+{
+    return handle_slots[slot];
+}
+
+//Interpreter
+
+thread_local bool interpreter_exists = false; //The state it would reset is per thread
+
+lisp_interpreter::lisp_interpreter(const char* image)
+{
+    if(interpreter_exists)
+        throw SimpleError("lisp_interpreter: one per thread");
+    if(image)
+        load_image(image);
+    else
+        init_global_env();
+    interpreter_exists = true;
+}
+
+lisp_interpreter::~lisp_interpreter()
+{
+    interpreter_exists = false;
+}
+
+lisp_handle lisp_interpreter::read(const std::string& source)
+{
+    read_source(source);
+    return lisp_handle(val);
+}
+
+lisp_handle lisp_interpreter::eval(const std::string& source)
+{
+    lisp_handle forms = read(source);
+    lisp_handle result;
+    while(!null(forms.get())) {
+        result = eval_form(lisp_handle(car(forms.get().id)));
+        forms = lisp_handle(cdr(forms.get().id));
+    }
+    return result;
+}
+
+lisp_handle lisp_interpreter::eval_form(const lisp_handle& form)
+{
+    const unsigned saved_pointer = stack_pointer;
+    push(env);
+    try {
+        evaluation_scope scope(limits);
+        expr = form.get();
+        env = global_environment;
+        optimize();
+        ::eval();
+    } catch(...) {
+        stack_set(saved_pointer + 1);
+        pop(env);
+        throw;
+    }
+    pop(env);
+    return lisp_handle(val);
+}
+
+lisp_handle lisp_interpreter::call(const lisp_handle& procedure,const std::vector<lisp_handle>& args)
+{
+    const unsigned saved_pointer = stack_pointer;
+    push(env);
+    try {
+        evaluation_scope scope(limits);
+        push(unev); //apply_procedure pops it
+        for(const lisp_handle& arg : args)
+            push(arg.get());
+        proc = procedure.get();
+        apply_procedure(args.size());
+    } catch(...) {
+        stack_set(saved_pointer + 1);
+        pop(env);
+        throw;
+    }
+    pop(env);
+    return lisp_handle(val);
+}
+
+void lisp_interpreter::define(const char* name,const lisp_handle& value)
+{
+    push(env);
+    env = global_environment;
+    extend_environment(intern(name),value.get());
+    pop(env);
+}
+
+void lisp_interpreter::define_primitive(const char* name,primitive_procedure adress,int min_args,int max_args)
+{
+    ::define_primitive(name,adress,min_args,max_args);
+}
+
+void lisp_interpreter::set_limits(const evaluation_limits& new_limits)
+{
+    limits = new_limits;
+}
+
+void lisp_interpreter::interrupt(void)
+{
+    request_interrupt();
+}
@@ -0,0 +1,65 @@
+#ifndef EMBED_HPP_INCLUDED
+#define EMBED_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include "lisp.hpp"
+
+//Embedding API
+/*
+    Every source file but main.cpp makes the library, liblisp.a as tests/run.sh builds it,
+    main.cpp is its REPL.
+    The interpreter state belongs to the calling thread: registers, heap, global environment.
+    So a thread has one lisp_interpreter at a time, constructing a second throws SimpleError.
+    Any evaluation or allocation may move objects, so objects kept in C++ between calls are
+    held by handles, whose slots the collector updates. Handles belong to the thread too.
+    Errors are thrown as SimpleError, the interpreter stays usable afterwards.
+    An evaluation over its limits, or interrupted, throws interruption (see safepoint.cpp).
+
+        lisp_interpreter lisp;
+        lisp.define_primitive("square",prim_square,1,1);
+        lisp_handle result = lisp.eval("(define (f x) (square x)) (f 12)");
+
+    A native primitive follows the protocol of the built-ins: its args are stack_get(argc - 1)
+    (first) to stack_get(0) (last), it leaves its result in val. The count is checked against
+    the arity given at registration. Register them before parallel-map or future start isolates.
+*/
+
+class lisp_handle
+{
+public:
+    lisp_handle(lisp_object obj = nil);
+    lisp_handle(const lisp_handle& other);
+    lisp_handle& operator=(const lisp_handle& other);
+    ~lisp_handle();
+
+    lisp_object get(void) const;
+
+private:
+    unsigned slot;
+};
+
+class lisp_interpreter
+{
+public:
+    explicit lisp_interpreter(const char* image = nullptr); //A fresh global environment or a saved image
+    lisp_interpreter(const lisp_interpreter&) = delete;
+    lisp_interpreter& operator=(const lisp_interpreter&) = delete;
+    ~lisp_interpreter();
+
+    lisp_handle read(const std::string& source); //The list of forms, not evaluated
+    lisp_handle eval(const std::string& source); //Evaluates every form, returns the last value
+    lisp_handle eval_form(const lisp_handle& form);
+    lisp_handle call(const lisp_handle& procedure,const std::vector<lisp_handle>& args);
+
+    void define(const char* name,const lisp_handle& value); //Global binding
+    void define_primitive(const char* name,primitive_procedure adress,int min_args,int max_args = -1);
+
+    void set_limits(const evaluation_limits& new_limits); //For each eval_form or call
+    static void interrupt(void); //From any thread or a signal handler
+
+private:
+    evaluation_limits limits;
+};
+
+#endif // EMBED_HPP_INCLUDED
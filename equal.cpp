@@ -0,0 +1,156 @@
+//Structural equality and hashing
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "lisp.hpp"
+
+/*
+    equal? walks pairs, strings and vectors with a work stack of pairs still to compare,
+    the cdr of a list is followed in place so long lists do not grow it.
+    Nothing is allocated, so objects do not move during a comparison.
+    eqv? is eq? but for bignums, which compare by value.
+    equal-hash agrees with equal?: equal objects hash alike. Objects compared by identity
+    that the collector moves hash by their type only.
+*/
+
+thread_local std::vector<std::pair<lisp_object,lisp_object>> equal_work;
+
+bool leafp(lisp_object obj) //Equal only if eqv
+{
+    return !typep(obj,cons_cell) && !typep(obj,lisp_string) && !typep(obj,lisp_vector) && !typep(obj,bignum);
+}
+
+bool equal_objects(lisp_object o1,lisp_object o2,bool structural) //Not structural: eqv?
+{
+    equal_work.clear();
+    equal_work.emplace_back(o1,o2);
+    while(!equal_work.empty()) {
+        lisp_object a = equal_work.back().first, b = equal_work.back().second;
+        equal_work.pop_back();
+        for(;;) {
+            if(eq(a,b))
+                break;
+            if(object_type(a) != object_type(b))
+                return false;
+            if(typep(a,bignum)) { //(bigger . lower)
+                equal_work.emplace_back(cdr(a.id),cdr(b.id));
+                a = car(a.id);
+                b = car(b.id);
+                continue;
+            }
+            if(!structural)
+                return false;
+            if(typep(a,cons_cell)) {
+                equal_work.emplace_back(car(a.id),car(b.id));
+                a = cdr(a.id);
+                b = cdr(b.id);
+                continue;
+            }
+            if(typep(a,lisp_string)) {
+                if(vector_length(a) != vector_length(b) ||
+                   memcmp(deref_string(a),deref_string(b),vector_length(a)) != 0)
+                    return false;
+                break;
+            }
+            if(typep(a,lisp_vector)) {
+                const unsigned length = vector_length(a);
+                if(length != vector_length(b))
+                    return false;
+                const lisp_object* elements1 = deref_vector(a);
+                const lisp_object* elements2 = deref_vector(b);
+                if(memcmp(elements1,elements2,length*sizeof(lisp_object)) == 0)
+                    break;
+                for(unsigned i = 0;i < length;++i) {
+                    if(eq(elements1[i],elements2[i]))
+                        continue;
+                    if(leafp(elements1[i]) && leafp(elements2[i]))
+                        return false;
+                    equal_work.emplace_back(elements1[i],elements2[i]);
+                }
+                break;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+//Hashing
+
+const unsigned hash_nodes = 1024; //Larger objects hash by their first nodes
+
+uint64_t hash_mix(uint64_t hash,uint64_t word)
+{
+    return (hash ^ word) * 0x100000001b3ull;
+}
+
+uint64_t hash_bytes(uint64_t hash,const byte_t* bytes,unsigned length)
+{
+    for(unsigned i = 0;i < length;++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+thread_local std::vector<lisp_object> hash_work;
+
+bool stable_identityp(lisp_object obj) //Its id does not change in a collection
+{
+    return typep(obj,fixnum) || typep(obj,character) || typep(obj,boolean) || typep(obj,symbol) ||
+           typep(obj,primitive);
+}
+
+uint64_t equal_hash(lisp_object obj)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash_work.clear();
+    hash_work.push_back(obj);
+    for(unsigned nodes = 0;!hash_work.empty() && nodes < hash_nodes;++nodes) {
+        const lisp_object current = hash_work.back();
+        hash_work.pop_back();
+        hash = hash_mix(hash,static_cast<uint64_t>(object_type(current)));
+        if(typep(current,cons_cell) || typep(current,bignum)) {
+            hash_work.push_back(cdr(current.id));
+            hash_work.push_back(car(current.id));
+        } else if(typep(current,lisp_string)) {
+            hash = hash_bytes(hash,deref_string(current),vector_length(current));
+        } else if(typep(current,lisp_vector)) {
+            const unsigned length = vector_length(current);
+            hash = hash_mix(hash,length);
+            for(unsigned i = std::min(length,hash_nodes);i > 0;--i)
+                hash_work.push_back(deref_vector(current)[i - 1]);
+        } else if(stable_identityp(current)) {
+            hash = hash_mix(hash,current.id);
+#ifdef LISP_NAN_BOXING
+        } else if(typep(current,double_float)) {
+            uint64_t bits;
+            memcpy(&bits,&current,sizeof(bits));
+            hash = hash_mix(hash,bits);
+#endif
+        }
+    }
+    return hash;
+}
+
+//Primitives
+
+void prim_equal(unsigned num)
+{
+    if(num != 2)
+        throw SimpleError("equal?: two args awaited");
+    val = equal_objects(stack_get(1),stack_get(0),true) ? val_true : val_false;
+}
+
+void prim_eqv(unsigned num)
+{
+    if(num != 2)
+        throw SimpleError("eqv?: two args awaited");
+    val = equal_objects(stack_get(1),stack_get(0),false) ? val_true : val_false;
+}
+
+void prim_equal_hash(unsigned num) //A non-negative fixnum
+{
+    if(num != 1)
+        throw SimpleError("equal-hash: one arg awaited");
+    const uint64_t hash = equal_hash(stack_get(0));
+    val = number(static_cast<object_word>((hash ^ (hash >> 32)) & (fixnum_negative_flag - 1)));
+}
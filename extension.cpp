@@ -0,0 +1,64 @@
+//Native extensions and byte access to strings
+#include <dlfcn.h>
+#include "extension.hpp"
+
+byte_t* string_bytes(lisp_object obj,unsigned& length)
+{
+    if(!typep(obj,lisp_string))
+        throw SimpleError("string awaited");
+    length = vector_length(obj);
+    return writable_string(obj);
+}
+
+unsigned byte_index(lisp_object str,lisp_object index,const char* msg)
+{
+    if(!typep(str,lisp_string) || !typep(index,fixnum) || index.id >= vector_length(str))
+        throw SimpleError(msg);
+    return index.id;
+}
+
+//Primitives
+
+void prim_load_extension(unsigned num) //(load-extension "lib.so") registers the primitives it exports
+{
+    if(num != 1 || !typep(stack_get(0),lisp_string))
+        throw SimpleError("load-extension: file name awaited");
+    const std::string path(reinterpret_cast<char*>(deref_string(stack_get(0))),vector_length(stack_get(0)));
+    void* library = dlopen(path.c_str(),RTLD_NOW | RTLD_LOCAL); //Never closed, its code stays in use
+    if(!library)
+        throw SimpleError("load-extension: cannot open shared object");
+    const auto* table = static_cast<const lisp_extension_primitive*>(dlsym(library,lisp_extension_table));
+    if(!table)
+        throw SimpleError("load-extension: no lisp_extension_primitives table");
+    unsigned count = 0;
+    for(;table->name;++table,++count)
+        define_primitive(table->name,table->adress,table->min_args,table->max_args);
+    val = number(static_cast<int>(count));
+}
+
+void prim_make_byte_string(unsigned num) //(make-byte-string length [byte])
+{
+    if((num != 1 && num != 2) || !typep(stack_get(num - 1),fixnum) || (stack_get(num - 1).id & fixnum_negative_flag) ||
+       (num == 2 && (!typep(stack_get(0),fixnum) || stack_get(0).id > 255)))
+        throw SimpleError("make-byte-string: length and byte awaited");
+    const unsigned length = stack_get(num - 1).id;
+    const std::string content(length,num == 2 ? static_cast<char>(stack_get(0).id) : '\0');
+    val = make_string(length,content.data());
+}
+
+void prim_string_byte_ref(unsigned num)
+{
+    if(num != 2)
+        throw SimpleError("string-byte-ref: string and index awaited");
+    const unsigned index = byte_index(stack_get(1),stack_get(0),"string-byte-ref: string and index awaited");
+    val = number(static_cast<int>(deref_string(stack_get(1))[index]));
+}
+
+void prim_string_byte_set(unsigned num)
+{
+    if(num != 3 || !typep(stack_get(0),fixnum) || stack_get(0).id > 255)
+        throw SimpleError("string-byte-set!: string, index and byte awaited");
+    const unsigned index = byte_index(stack_get(2),stack_get(1),"string-byte-set!: string, index and byte awaited");
+    writable_string(stack_get(2))[index] = stack_get(0).id;
+    val = stack_get(0);
+}
@@ -0,0 +1,39 @@
+#ifndef EXTENSION_HPP_INCLUDED
+#define EXTENSION_HPP_INCLUDED
+
+#include "lisp.hpp"
+
+//Native extensions
+/*
+    A shared object loaded by (load-extension "path") exports a table of primitives,
+    ended by an entry with a null name:
+
+        void prim_checksum(unsigned num) {...}
+
+        extern "C" const lisp_extension_primitive lisp_extension_primitives[] =
+            {{"checksum",prim_checksum,1,1},
+             {nullptr,nullptr,0,0}};
+
+    Primitives follow the built-in protocol, see embed.hpp. The interpreter is linked with
+    -rdynamic so that extensions can call stack_get, make_string and the others.
+*/
+
+struct lisp_extension_primitive
+{
+    const char* name;
+    primitive_procedure adress;
+    int min_args;
+    int max_args; //-1 for any count
+};
+
+const char* const lisp_extension_table = "lisp_extension_primitives";
+
+//In place access to the bytes of a string
+/*
+    The pointer is valid until the next allocation, which may move the string.
+    Strings of large_object_bytes and more live in the large-object space and never move.
+    A large string sharing its bytes with substring slices gets its own copy first.
+*/
+byte_t* string_bytes(lisp_object obj,unsigned& length);
+
+#endif // EXTENSION_HPP_INCLUDED
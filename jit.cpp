@@ -0,0 +1,675 @@
+//Template JIT: hot compound procedures are compiled to x86-64 code
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <exception>
+#include <unordered_map>
+#include <sys/mman.h>
+#include "lisp.hpp"
+
+/*
+    A procedure is compiled when apply_compound has seen its body jit_threshold times.
+    Supported bodies: parameters, constants, global or closed-over variables,
+    if, begin, set! of a parameter and calls. No lambda or define inside, except
+    a closure applied in place, as let expands: its bindings become temporaries.
+    car, cdr, +, -, * of two args, eq? and null? inlined by the optimizer
+    get fixnum/pair fast paths, a failed type guard calls the primitive itself.
+
+    Frame on the Lisp stack: arguments, the procedure, temporaries.
+    Every value that lives across a helper call is in the frame, so GC sees it.
+    rbx points to the frame, r12d is its stack index, eax holds the current value.
+    Helpers catch exceptions and return 1, the code returns 1 and jit_apply rethrows,
+    so C++ unwinding never crosses generated code.
+    Code is per isolate: it embeds the addresses of its thread_local registers.
+    jit_invalidate drops every entry; the region and the constants are reused once no
+    jit_apply is under way, as code may still run below the call that invalidated it.
+*/
+
+std::atomic<unsigned> jit_threshold(50); //0 disables compilation
+
+#if defined(__x86_64__) && !defined(LISP_NAN_BOXING) //Code assumes 32-bit objects
+
+using jit_code = int (*)(lisp_object* frame,unsigned base);
+
+//Status returned by code: 0, error, or a tail call with arguments and procedure at the frame start
+const int jit_error_status = 1;
+const int jit_tail_call = 2;
+
+struct jit_entry
+{
+    unsigned calls;
+    bool failed;
+    bool global_only; //Code caches global bindings
+    unsigned argc;
+    unsigned temps;
+    jit_code code;
+};
+
+thread_local std::unordered_map<unsigned,jit_entry> jit_entries; //By body cell
+thread_local std::exception_ptr jit_error;
+
+const unsigned max_constants = 4096;
+thread_local lisp_object jit_constants[max_constants]; //Heap objects referenced by code, traced by GC
+thread_local unsigned jit_constants_count = 0;
+
+const size_t region_size = 4 << 20;
+thread_local byte_t* jit_region = nullptr;
+thread_local size_t jit_region_used = 0;
+
+thread_local unsigned jit_running = 0; //jit_apply calls under way, suspended green threads included
+thread_local bool jit_stale = false; //Invalidated code to reclaim once none runs
+
+static_assert(sizeof(lisp_object) == 4,"JIT needs 32-bit objects");
+
+uint32_t raw(lisp_object obj)
+{
+    uint32_t res;
+    memcpy(&res,&obj,sizeof(res));
+    return res;
+}
+
+lisp_object from_raw(uint32_t value)
+{
+    lisp_object res;
+    memcpy(&res,&value,sizeof(res));
+    return res;
+}
+
+bool layout_supported(void) //Tag in the low byte, id above it
+{
+    return raw(make_obj(fixnum,1)) == ((1u << 8) | static_cast<unsigned>(lisp_type::fixnum)) && raw(nil) == 0;
+}
+
+//Helpers called from generated code
+
+template<typename F>
+int guarded(F body)
+{
+    try {
+        body();
+        return 0;
+    } catch(...) {
+        jit_error = std::current_exception();
+        return 1;
+    }
+}
+
+int jit_helper_call(unsigned argc) //Procedure and arguments are on the stack
+{
+    return guarded([argc]{
+        proc = stack_get(argc);
+        stack[stack_pointer - argc - 1] = unev; //apply_procedure pops it
+        apply_procedure(argc);
+    });
+}
+
+int jit_helper_primitive(unsigned index,unsigned argc) //Slow path of an inlined primitive
+{
+    return guarded([index,argc]{
+        primitive_adress(make_obj(primitive,index))(argc);
+        stack_drop(argc);
+    });
+}
+
+int jit_helper_lookup(uint32_t procedure,uint32_t sym)
+{
+    return guarded([procedure,sym]{
+        env = cdr(cdr(from_raw(procedure).id).id);
+        find_var(from_raw(sym));
+    });
+}
+
+//Assembler
+
+struct jit_compiler
+{
+    std::vector<byte_t> code;
+    std::vector<size_t> error_jumps;
+    std::vector<size_t> exit_jumps;
+    std::vector<unsigned> params;
+    std::vector<std::pair<unsigned,unsigned>> locals; //Symbol and temporary of a let binding, innermost last
+    lisp_object procedure;
+    bool global_env;
+    bool global_only;
+    unsigned depth;
+    unsigned max_depth;
+
+    void byte(unsigned b) {code.push_back(b);}
+    void bytes(std::initializer_list<unsigned> list) {for(unsigned b : list) byte(b);}
+    void imm32(uint32_t value) {for(int i = 0;i < 4;++i) byte((value >> (8*i)) & 0xff);}
+    void imm64(uint64_t value) {for(int i = 0;i < 8;++i) byte((value >> (8*i)) & 0xff);}
+
+    size_t jump(std::initializer_list<unsigned> opcode) //Returns position of rel32
+    {
+        bytes(opcode);
+        imm32(0);
+        return code.size() - 4;
+    }
+    void land(size_t position) //Binds the jump at position to here
+    {
+        const uint32_t rel = code.size() - (position + 4);
+        memcpy(&code[position],&rel,4);
+    }
+
+    unsigned slot(unsigned temp) {return 4*(params.size() + 1 + temp);}
+    void load_slot(uint32_t disp) {bytes({0x8b,0x83}); imm32(disp);} //mov eax,[rbx+disp]
+    void store_slot(uint32_t disp) {bytes({0x89,0x83}); imm32(disp);} //mov [rbx+disp],eax
+    void load_rcx(const void* address) {bytes({0x48,0xb9}); imm64(reinterpret_cast<uint64_t>(address));}
+    void load_eax(uint32_t value) {byte(0xb8); imm32(value);}
+
+    void push_temp(void) //eax to a new temporary
+    {
+        store_slot(slot(depth++));
+        max_depth = std::max(max_depth,depth);
+    }
+
+    void set_stack_pointer(unsigned temps) //Frame with temps temporaries is live
+    {
+        bytes({0x44,0x89,0xe0}); //mov eax,r12d
+        byte(0x05); imm32(params.size() + 1 + temps); //add eax,n
+        load_rcx(&stack_pointer);
+        bytes({0x89,0x01}); //mov [rcx],eax
+    }
+
+    void call(const void* helper) //Status checked, val loaded to eax
+    {
+        bytes({0x48,0xb8}); imm64(reinterpret_cast<uint64_t>(helper)); //mov rax,helper
+        bytes({0xff,0xd0}); //call rax
+        bytes({0x85,0xc0}); //test eax,eax
+        error_jumps.push_back(jump({0x0f,0x85})); //jnz error
+        load_rcx(&val);
+        bytes({0x8b,0x01}); //mov eax,[rcx]
+    }
+
+    void boolean_from_flags(void) //eax = ZF ? #t : #f
+    {
+        load_eax(raw(val_false));
+        byte(0xba); imm32(raw(val_true)); //mov edx,#t
+        bytes({0x0f,0x44,0xc2}); //cmove eax,edx
+    }
+
+    bool constant(lisp_object obj)
+    {
+        if(immediatep(obj)) {
+            load_eax(raw(obj));
+            return true;
+        }
+        if(jit_constants_count == max_constants)
+            return false;
+        jit_constants[jit_constants_count] = obj;
+        load_rcx(&jit_constants[jit_constants_count++]);
+        bytes({0x8b,0x01}); //mov eax,[rcx]
+        return true;
+    }
+
+    int param_index(lisp_object sym)
+    {
+        for(size_t i = 0;i < params.size();++i)
+            if(params[i] == sym.id)
+                return i;
+        return -1;
+    }
+
+    int local_slot(lisp_object sym) //Frame displacement of a let binding or a parameter, -1 if neither
+    {
+        for(auto local = locals.rbegin();local != locals.rend();++local)
+            if(local->first == sym.id)
+                return slot(local->second);
+        const int index = param_index(sym);
+        return index == -1 ? -1 : 4*index;
+    }
+
+    lisp_object global_binding(lisp_object sym)
+    {
+        return global_env ? assoc(sym,car(global_environment.id)) : nil;
+    }
+
+    bool variable(lisp_object sym)
+    {
+        const int disp = local_slot(sym);
+        if(disp != -1) {
+            load_slot(disp);
+            return true;
+        }
+        const lisp_object binding = global_binding(sym);
+        if(!null(binding)) { //Redefinition updates the same binding
+            global_only = true;
+            if(!constant(binding))
+                return false;
+            bytes({0xc1,0xe8,0x08}); //shr eax,8
+            load_rcx(&working_memory);
+            bytes({0x48,0x8b,0x09}); //mov rcx,[rcx]
+            bytes({0x8b,0x44,0xc1,0x04}); //mov eax,[rcx+rax*8+4]
+            return true;
+        }
+        set_stack_pointer(depth);
+        bytes({0x8b,0xbb}); imm32(4*params.size()); //mov edi,[rbx+procedure]
+        byte(0xbe); imm32(raw(sym)); //mov esi,sym
+        call(reinterpret_cast<const void*>(jit_helper_lookup));
+        return true;
+    }
+
+    bool sequence(lisp_object forms,bool tail)
+    {
+        if(!typep(forms,cons_cell))
+            return false;
+        for(;typep(forms,cons_cell);forms = cdr(forms.id))
+            if(!expression(car(forms.id),tail && null(cdr(forms.id))))
+                return false;
+        return null(forms);
+    }
+
+    bool conditional(lisp_object form,bool tail)
+    {
+        const unsigned count = length_of(form);
+        if(count != 3 && count != 4)
+            return false;
+        if(!expression(car(cdr(form.id).id)))
+            return false;
+        byte(0x3d); imm32(raw(val_false)); //cmp eax,#f
+        const size_t to_alternative = jump({0x0f,0x84}); //je
+        if(!expression(car(cdr(cdr(form.id).id).id),tail))
+            return false;
+        const size_t to_end = jump({0xe9});
+        land(to_alternative);
+        if(count == 4) {
+            if(!expression(car(cdr(cdr(cdr(form.id).id).id).id),tail))
+                return false;
+        } else {
+            load_eax(raw(nil));
+        }
+        land(to_end);
+        return true;
+    }
+
+    bool assignment(lisp_object form)
+    {
+        if(length_of(form) != 3 || !typep(car(cdr(form.id).id),symbol))
+            return false;
+        const int disp = local_slot(car(cdr(form.id).id));
+        if(disp == -1 || !expression(car(cdr(cdr(form.id).id).id)))
+            return false;
+        store_slot(disp); //No closures capture the frame
+        return true;
+    }
+
+    void slow_primitive(lisp_object op,unsigned argc) //Operands are in the top temporaries
+    {
+        set_stack_pointer(depth + argc);
+        byte(0xbf); imm32(op.id); //mov edi,index
+        byte(0xbe); imm32(argc); //mov esi,argc
+        call(reinterpret_cast<const void*>(jit_helper_primitive));
+    }
+
+    bool inline_unary(lisp_object op,lisp_object arg)
+    {
+        const primitive_procedure adress = primitive_adress(op);
+        if(!expression(arg))
+            return false;
+        if(adress == prim_null) {
+            bytes({0x85,0xc0}); //test eax,eax
+            boolean_from_flags();
+            return true;
+        }
+        bytes({0x3c,static_cast<unsigned>(lisp_type::cons_cell)}); //cmp al,pair
+        const size_t to_slow = jump({0x0f,0x85});
+        bytes({0xc1,0xe8,0x08}); //shr eax,8
+        load_rcx(&working_memory);
+        bytes({0x48,0x8b,0x09}); //mov rcx,[rcx]
+        if(adress == prim_car)
+            bytes({0x8b,0x04,0xc1}); //mov eax,[rcx+rax*8]
+        else
+            bytes({0x8b,0x44,0xc1,0x04}); //mov eax,[rcx+rax*8+4]
+        const size_t to_end = jump({0xe9});
+        land(to_slow);
+        store_slot(slot(depth));
+        max_depth = std::max(max_depth,depth + 1);
+        slow_primitive(op,1);
+        land(to_end);
+        return true;
+    }
+
+    bool inline_binary(lisp_object op,lisp_object first,lisp_object second)
+    {
+        const primitive_procedure adress = primitive_adress(op);
+        if(!expression(first))
+            return false;
+        push_temp();
+        if(!expression(second))
+            return false;
+        bytes({0x89,0xc1}); //mov ecx,eax
+        load_slot(slot(--depth));
+        if(adress == prim_eq) {
+            bytes({0x39,0xc8}); //cmp eax,ecx
+            boolean_from_flags();
+            return true;
+        }
+        const unsigned fixnum_tag = static_cast<unsigned>(lisp_type::fixnum);
+        bytes({0x3c,fixnum_tag}); //cmp al,fixnum
+        const size_t first_slow = jump({0x0f,0x85});
+        bytes({0x80,0xf9,fixnum_tag}); //cmp cl,fixnum
+        const size_t second_slow = jump({0x0f,0x85});
+        if(adress == prim_add) {
+            bytes({0x8d,0x44,0x08,0x100 - fixnum_tag}); //lea eax,[rax+rcx-tag]
+        } else if(adress == prim_sub) {
+            bytes({0x29,0xc8}); //sub eax,ecx
+            bytes({0x83,0xc0,fixnum_tag}); //add eax,tag
+        } else {
+            bytes({0x89,0xc2}); //mov edx,eax
+            bytes({0xc1,0xea,0x08}); //shr edx,8
+            bytes({0xc1,0xe9,0x08}); //shr ecx,8
+            bytes({0x0f,0xaf,0xd1}); //imul edx,ecx
+            bytes({0xc1,0xe2,0x08}); //shl edx,8
+            bytes({0x83,0xca,fixnum_tag}); //or edx,tag
+            bytes({0x89,0xd0}); //mov eax,edx
+        }
+        const size_t to_end = jump({0xe9});
+        land(first_slow);
+        land(second_slow);
+        store_slot(slot(depth)); //First operand is still in its temporary
+        bytes({0x89,0xc8}); //mov eax,ecx
+        store_slot(slot(depth + 1));
+        max_depth = std::max(max_depth,depth + 2);
+        slow_primitive(op,2);
+        land(to_end);
+        return true;
+    }
+
+    void tail_call(unsigned argc) //Procedure and arguments in temporaries from depth
+    {
+        bytes({0x8b,0x93}); imm32(slot(depth)); //mov edx,[rbx+procedure]
+        for(unsigned i = 0;i < argc;++i) { //Down to the frame start, never overlaps ahead
+            load_slot(slot(depth + 1 + i));
+            store_slot(4*i);
+        }
+        bytes({0x89,0x93}); imm32(4*argc); //mov [rbx+4*argc],edx
+        load_eax(jit_tail_call + argc);
+        exit_jumps.push_back(jump({0xe9}));
+    }
+
+    bool inline_closure(lisp_object form,bool tail) //((%closure free params [%stack-frame] . body) . args)
+    {
+        const lisp_object closure = cdr(car(form.id).id); //(free params . body)
+        if(!typep(closure,cons_cell) || !typep(cdr(closure.id),cons_cell))
+            return false;
+        lisp_object body = cdr(cdr(closure.id).id);
+        if(typep(body,cons_cell) && eq(car(body.id),sym_stack_frame))
+            body = cdr(body.id);
+        const unsigned base_depth = depth;
+        lisp_object params = car(cdr(closure.id).id), args = cdr(form.id);
+        for(;typep(params,cons_cell) && typep(args,cons_cell);params = cdr(params.id),args = cdr(args.id)) {
+            if(!typep(car(params.id),symbol) || !expression(car(args.id)))
+                return false;
+            push_temp();
+        }
+        if(!null(params) || !null(args))
+            return false; //Rest parameters and arity errors are left to the interpreter
+        const size_t base_locals = locals.size();
+        unsigned temp = base_depth;
+        for(params = car(cdr(closure.id).id);typep(params,cons_cell);params = cdr(params.id))
+            locals.emplace_back(car(params.id).id,temp++); //Bound after the arguments, as let
+        const bool compiled = sequence(body,tail);
+        locals.resize(base_locals);
+        depth = base_depth;
+        return compiled;
+    }
+
+    bool application(lisp_object form,bool tail)
+    {
+        const lisp_object op = car(form.id);
+        const unsigned argc = length_of(form) - 1;
+        if(typep(op,cons_cell) && eq(car(op.id),sym_closure))
+            return inline_closure(form,tail);
+        if(typep(op,primitive)) {
+            const primitive_procedure adress = primitive_adress(op);
+            if(argc == 1 && (adress == prim_car || adress == prim_cdr || adress == prim_null))
+                return inline_unary(op,car(cdr(form.id).id));
+            if(argc == 2 && (adress == prim_add || adress == prim_sub || adress == prim_mul || adress == prim_eq))
+                return inline_binary(op,car(cdr(form.id).id),car(cdr(cdr(form.id).id).id));
+        } else if(typep(op,symbol) && local_slot(op) == -1) {
+            const lisp_object binding = global_env ? global_binding(op) : nil;
+            if(!null(binding) && typep(cdr(binding.id),macro))
+                return false; //Not expanded yet
+        }
+
+        const unsigned base_depth = depth;
+        for(lisp_object current = form;typep(current,cons_cell);current = cdr(current.id)) {
+            if(!expression(car(current.id)))
+                return false;
+            push_temp();
+        }
+        depth = base_depth;
+        if(tail) {
+            tail_call(argc);
+            return true;
+        }
+        set_stack_pointer(depth + argc + 1);
+        byte(0xbf); imm32(argc); //mov edi,argc
+        call(reinterpret_cast<const void*>(jit_helper_call));
+        return true;
+    }
+
+    bool expression(lisp_object expr,bool tail = false)
+    {
+        if(typep(expr,symbol))
+            return variable(expr);
+        if(!typep(expr,cons_cell))
+            return constant(expr);
+        const lisp_object head = car(expr.id);
+        if(eq(head,sym_quote) && local_slot(head) == -1) //(quote . datum) is an improper form
+            return constant(cdr(expr.id));
+        if(length_of(expr) == 0) //Improper form
+            return false;
+
+        if(typep(head,symbol) && local_slot(head) == -1) {
+            if(eq(head,sym_if))
+                return conditional(expr,tail);
+            if(eq(head,sym_begin))
+                return sequence(cdr(expr.id),tail);
+            if(eq(head,sym_set))
+                return assignment(expr);
+            if(eq(head,sym_lambda) || eq(head,sym_closure) || eq(head,sym_define) || eq(head,sym_define_syntax) ||
+               eq(head,sym_delay) || eq(head,sym_cons_stream) || derivedp(expr))
+                return false;
+        }
+        return application(expr,tail);
+    }
+
+    unsigned length_of(lisp_object lst) //0 for improper lists
+    {
+        unsigned count = 0;
+        for(;typep(lst,cons_cell);lst = cdr(lst.id))
+            ++count;
+        return null(lst) ? count : 0;
+    }
+
+    bool immediatep(lisp_object obj)
+    {
+        return typep(obj,fixnum) || typep(obj,boolean) || typep(obj,character) || typep(obj,primitive) || null(obj);
+    }
+
+    bool compile(void)
+    {
+        lisp_object current = car(procedure.id);
+        for(;typep(current,cons_cell);current = cdr(current.id)) {
+            if(!typep(car(current.id),symbol) || param_index(car(current.id)) != -1)
+                return false;
+            params.push_back(car(current.id).id);
+        }
+        if(!null(current))
+            return false;
+
+        bytes({0x53,0x41,0x54,0x41,0x55}); //push rbx; push r12; push r13
+        bytes({0x48,0x89,0xfb}); //mov rbx,rdi
+        bytes({0x41,0x89,0xf4}); //mov r12d,esi
+        lisp_object body = car(cdr(procedure.id).id);
+        if(typep(body,cons_cell) && eq(car(body.id),sym_stack_frame)) //Native frames are on the stack already
+            body = cdr(body.id);
+        if(!sequence(body,true))
+            return false;
+        load_rcx(&val);
+        bytes({0x89,0x01}); //mov [rcx],eax
+        bytes({0x31,0xc0}); //xor eax,eax
+        exit_jumps.push_back(jump({0xe9}));
+        for(size_t position : error_jumps)
+            land(position);
+        load_eax(jit_error_status);
+        for(size_t position : exit_jumps)
+            land(position);
+        bytes({0x41,0x5d,0x41,0x5c,0x5b,0xc3}); //pop r13; pop r12; pop rbx; ret
+        return true;
+    }
+};
+
+jit_code install(const std::vector<byte_t>& code)
+{
+    if(!jit_region) {
+        void* region = mmap(nullptr,region_size,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+        if(region == MAP_FAILED)
+            return nullptr;
+        jit_region = static_cast<byte_t*>(region);
+    }
+    if(jit_region_used + code.size() > region_size)
+        return nullptr;
+    if(mprotect(jit_region,region_size,PROT_READ | PROT_WRITE) != 0)
+        return nullptr;
+    byte_t* location = jit_region + jit_region_used;
+    memcpy(location,code.data(),code.size());
+    jit_region_used += (code.size() + 15) & ~size_t(15);
+    if(mprotect(jit_region,region_size,PROT_READ | PROT_EXEC) != 0)
+        return nullptr;
+    return reinterpret_cast<jit_code>(location);
+}
+
+bool jit_compile(jit_entry& entry)
+{
+    if(!layout_supported())
+        return false;
+    const unsigned saved_constants = jit_constants_count;
+    jit_compiler compiler;
+    compiler.procedure = proc; //(params . (body . env))
+    compiler.global_env = eq(cdr(cdr(proc.id).id),global_environment);
+    compiler.global_only = false;
+    compiler.depth = compiler.max_depth = 0;
+    if(!compiler.compile() || !(entry.code = install(compiler.code))) {
+        jit_constants_count = saved_constants;
+        return false;
+    }
+    entry.global_only = compiler.global_only;
+    entry.argc = compiler.params.size();
+    entry.temps = compiler.max_depth;
+    return true;
+}
+
+jit_code native_code(unsigned argc) //Code for proc if it is hot and its frame fits the stack
+{
+    if(!jit_threshold)
+        return nullptr;
+    const lisp_object body = car(cdr(proc.id).id);
+    if(!typep(body,cons_cell))
+        return nullptr;
+    jit_entry& entry = jit_entries[body.id];
+    if(!entry.code) {
+        if(entry.failed || ++entry.calls < jit_threshold)
+            return nullptr;
+        if(!jit_compile(entry)) {
+            entry.failed = true;
+            return nullptr;
+        }
+    }
+    if(entry.argc != argc || (entry.global_only && !eq(cdr(cdr(proc.id).id),global_environment)) ||
+       stack_pointer + 1 + entry.temps >= stack_limit)
+        return nullptr; //The interpreter reports errors
+    return entry.code;
+}
+
+void jit_reclaim(void) //Region and constants start over
+{
+    jit_entries.clear();
+    jit_constants_count = 0;
+    jit_region_used = 0;
+    jit_stale = false;
+}
+
+struct jit_activation
+{
+    jit_activation() { ++jit_running; }
+    ~jit_activation() { if(--jit_running == 0 && jit_stale) jit_reclaim(); }
+};
+
+bool jit_apply(unsigned argc) //Runs the native code of proc, result in val. Pops args and unev as apply_procedure
+{
+    jit_code code = native_code(argc);
+    if(!code)
+        return false;
+    jit_activation activation;
+    const unsigned base = stack_pointer - argc; //unev of the caller is at base - 1
+    push(proc);
+    int status = 0;
+    safepoint_poll();
+    while((status = code(stack + base,base)) >= jit_tail_call) { //Tail calls reuse the frame
+        const unsigned count = status - jit_tail_call;
+        proc = stack[base + count];
+        stack_set(base + count);
+        if(typep(proc,compound) && (code = native_code(count))) {
+            push(proc);
+            safepoint_poll();
+            continue;
+        }
+        apply_procedure(count); //Pops unev of the caller with the args: a loop through it keeps the stack flat
+        return true;
+    }
+    if(status) {
+        stack_set(base + argc);
+        std::exception_ptr error = jit_error;
+        jit_error = nullptr;
+        std::rethrow_exception(error);
+    }
+    stack_set(base);
+    pop(unev);
+    return true;
+}
+
+void jit_collect(void) //Called by the collector before the pools are swapped
+{
+    for(unsigned i = 0;i < jit_constants_count;++i)
+        jit_constants[i] = gc_trace(jit_constants[i]);
+    std::unordered_map<unsigned,jit_entry> moved;
+    for(auto& entry : jit_entries)
+        if(typep(car(entry.first),broken_heart)) //Live bodies were moved
+            moved[cdr(entry.first).id] = entry.second;
+    jit_entries.swap(moved);
+}
+
+void jit_invalidate(void) //Running code stays in place until it returns
+{
+    jit_entries.clear();
+    if(jit_running)
+        jit_stale = true;
+    else
+        jit_reclaim();
+}
+
+#else
+
+bool jit_apply(unsigned argc)
+{
+    return false;
+}
+
+void jit_collect(void)
+{
+}
+
+void jit_invalidate(void)
+{
+}
+
+#endif
+
+void prim_jit_threshold(unsigned num) //(jit-threshold n) sets the call count, 0 disables
+{
+    if(num != 1 || !typep(stack_get(0),fixnum))
+        throw SimpleError("jit-threshold: fixnum awaited");
+    val = number(jit_threshold.exchange(stack_get(0).id));
+}
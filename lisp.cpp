@@ -1,13 +1,29 @@
 #include "lisp.hpp"
 #include <cassert>
-#include <iostream>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 //Object
 
-lisp_object make_lisp_object(lisp_type type,unsigned id)
+lisp_object make_lisp_object(lisp_type type,object_word id)
 {
     lisp_object res;
+#ifdef LISP_NAN_BOXING
+    res.box = 0;
+    res.tag_bits = static_cast<unsigned>(type);
+#else
     res.tag = type;
+#endif
     res.id = id;
     return res;
 }
@@ -17,18 +33,26 @@ lisp_object number(unsigned value)
     return make_obj(fixnum,value);
 }
 
-lisp_object number(int value)
+lisp_object number(int value) //Wraps to the fixnum width
 {
-    return lisp_object{lisp_type::fixnum, value};
+    return make_obj(fixnum,static_cast<object_word>(value));
 }
 
+#ifdef LISP_NAN_BOXING
+lisp_object number(object_word value)
+{
+    return make_obj(fixnum,value);
+}
+#endif
+
 int fxn_to_int(lisp_object fixnum)
 {
     return (fixnum.id);
 }
 
 //Obarray
-std::vector<symbol> obarray;
+std::vector<symbol> obarray; //Shared by all isolates
+std::mutex obarray_lock;
 
 bool same_strings(const char* str1, const char* str2)
 {
@@ -38,7 +62,7 @@ bool same_strings(const char* str1, const char* str2)
     return (*str1 == *str2);
 }
 
-int symbol_id(const char* name)
+int find_symbol(const char* name) //obarray_lock must be held
 {
 
     for(size_t i = 0;i != obarray.size();++i){
@@ -48,14 +72,22 @@ int symbol_id(const char* name)
     return -1;
 }
 
+int symbol_id(const char* name)
+{
+    std::lock_guard<std::mutex> guard(obarray_lock);
+    return find_symbol(name);
+}
+
 const char* get_symbol(unsigned id)
 {
+    std::lock_guard<std::mutex> guard(obarray_lock);
     return obarray.at(id);
 }
 
 lisp_object make_symbol(const char* name)
 {
-    int id = symbol_id(name);
+    std::lock_guard<std::mutex> guard(obarray_lock);
+    int id = find_symbol(name);
     if(id != -1)
         return make_obj(symbol,id);
 
@@ -63,16 +95,64 @@ lisp_object make_symbol(const char* name)
     return make_obj(symbol,obarray.size()-1);
 }
 
+lisp_object intern(const char* name) //make_symbol with a copy of a transient name
+{
+    const int id = symbol_id(name);
+    if(id != -1)
+        return make_obj(symbol,id);
+    char* new_location = new char[strlen(name) + 1];
+    strcpy(new_location,name);
+    return make_symbol(new_location);
+}
+
+lisp_object gensym(const char* prefix) //The name has a space, so the reader cannot produce it
+{
+    static std::atomic<unsigned> counter(0);
+    std::string name = " " + std::string(prefix) + std::to_string(counter++);
+    char* location = new char[name.size() + 1];
+    strcpy(location,name.c_str());
+    std::lock_guard<std::mutex> guard(obarray_lock);
+    obarray.push_back(location);
+    return make_obj(symbol,obarray.size()-1);
+}
+
 //Memory space
+const size_t image_alignment = 65536; //Heap offset in image files, any page size divides it
+#ifdef LISP_NAN_BOXING
+#ifndef LISP_POOL_CELLS
+#define LISP_POOL_CELLS (size_t(1) << 27) //2 GB per semispace, cell indices stay below 2^32
+#endif
+const size_t pool_size = LISP_POOL_CELLS;
+
+memory_cell* allocate_pool(void) //Too big for static data, pages are touched on demand
+{
+    void* pool = mmap(nullptr,pool_size*sizeof(memory_cell),PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,-1,0);
+    if(pool == MAP_FAILED)
+        throw std::bad_alloc();
+    return static_cast<memory_cell*>(pool);
+}
+
+memory_cell* const first_pool = allocate_pool(); //Pools of the main isolate
+memory_cell* const second_pool = allocate_pool();
+#else
 const size_t pool_size = 16777216; //2^24 = 16777216
-memory_cell first_pool[pool_size],second_pool[pool_size];
-memory_cell *working_memory = first_pool;
-memory_cell *free_memory = second_pool;
-unsigned int working_index = 0, free_index = 0;
+alignas(image_alignment) memory_cell first_pool[pool_size]; //Pools of the main isolate
+memory_cell second_pool[pool_size];
+#endif
+thread_local memory_cell *working_memory = first_pool;
+thread_local memory_cell *free_memory = second_pool;
+thread_local unsigned int working_index = 0, free_index = 0;
+
+//The last frame_cells cells of a pool are the frame region, see apply_compound
+const size_t frame_cells = pool_size / 256;
+const size_t heap_cells = pool_size - frame_cells;
+thread_local unsigned frame_index = heap_cells; //Frame region top
 
 unsigned allocate_pair(void)
 {
-    if (working_index < pool_size) {
+    --quantum_left;
+    if (working_index < heap_cells) {
         //working_memory[working_index].car = nil;
         //working_memory[working_index].cdr = nil;
         return working_index++;
@@ -98,15 +178,134 @@ unsigned bodyobjects_to_allcells(unsigned body_count)
 
 unsigned allocate_cells(unsigned count)
 {
-    if(working_index + count < pool_size) {
+    quantum_left -= count;
+    if(working_index + count < heap_cells) {
         unsigned temp = working_index;
         working_index += count;
         return temp;
     } else throw out_of_memory();
 }
 
+//Large objects
+/*
+    Strings and vectors of large_object_bytes and more keep their payload outside the pools.
+    In the heap such an object is one header cell: (large index . length).
+    The collector copies only the header and marks the payload, unmarked payloads are freed after it.
+    A large substring is a slice: its block points into the payload of its owner block,
+    which it keeps alive. Writes go through writable_string, copy on write: a slice, or an
+    owner with slices, first gets a payload of its own, the old one stays with the slices.
+*/
+
+const int no_owner = -1;
+
+struct large_block
+{
+    byte_t* payload;
+    size_t bytes;
+    bool marked;
+    int owner = no_owner; //Block holding the payload of a slice
+    bool shared = false; //Owner of slices
+};
+
+const unsigned large_object_bytes = 8192;
+const size_t large_space_step = 64 << 20; //Allocated bytes between collections caused by large objects
+
+thread_local std::vector<large_block> large_objects;
+thread_local std::vector<unsigned> free_large_objects;
+thread_local size_t large_bytes = 0, large_bytes_limit = large_space_step;
+
+bool largep(memory_adress cell)
+{
+    return typep(working_memory[cell].car,large);
+}
+
+bool large_space_full(void) //Checked by cons, where a collection is allowed
+{
+    return large_bytes > large_bytes_limit;
+}
+
+unsigned new_large_block(void) //Index of a free block, may move large_objects
+{
+    if(free_large_objects.empty()) {
+        large_objects.push_back(large_block{});
+        return large_objects.size() - 1;
+    }
+    const unsigned index = free_large_objects.back();
+    free_large_objects.pop_back();
+    return index;
+}
+
+unsigned allocate_large(size_t bytes,unsigned length)
+{
+    const unsigned id = allocate_pair();
+    const unsigned index = new_large_block();
+    large_objects[index] = large_block{new byte_t[bytes](),bytes,false};
+    large_bytes += bytes;
+    working_memory[id].car = make_obj(large,index);
+    working_memory[id].cdr = number(length);
+    return id;
+}
+
+unsigned allocate_large_slice(lisp_object str,unsigned start,unsigned length) //Of a large string
+{
+    const unsigned id = allocate_pair();
+    const unsigned index = new_large_block();
+    const large_block& parent = large_objects[working_memory[str.id].car.id];
+    const int owner = parent.owner == no_owner ? working_memory[str.id].car.id : parent.owner;
+    byte_t* const payload = parent.payload + start;
+    large_objects[owner].shared = true;
+    large_objects[index] = large_block{payload,length,false,owner};
+    working_memory[id].car = make_obj(large,index);
+    working_memory[id].cdr = number(length);
+    return id;
+}
+
+byte_t* writable_string(lisp_object string) //deref_string, unshared first
+{
+    if(!largep(string.id))
+        return deref_string(string);
+    const unsigned index = working_memory[string.id].car.id;
+    if(large_objects[index].owner == no_owner && !large_objects[index].shared)
+        return large_objects[index].payload;
+    if(large_objects[index].shared) { //The slices keep the old payload in a block of their own
+        const unsigned kept = new_large_block();
+        large_objects[kept] = large_block{large_objects[index].payload,large_objects[index].bytes,false};
+        for(large_block& block : large_objects)
+            if(block.owner == static_cast<int>(index))
+                block.owner = kept;
+    }
+    large_block& block = large_objects[index];
+    byte_t* const payload = new byte_t[block.bytes];
+    memcpy(payload,block.payload,block.bytes);
+    large_bytes += block.bytes;
+    block = large_block{payload,block.bytes,block.marked};
+    return payload;
+}
+
+void sweep_large_objects(void)
+{
+    for(size_t i = 0;i < large_objects.size();++i) {
+        large_block& block = large_objects[i];
+        if(!block.payload)
+            continue;
+        if(block.marked) {
+            block.marked = false;
+            continue;
+        }
+        if(block.owner == no_owner) {
+            large_bytes -= block.bytes;
+            delete[] block.payload;
+        }
+        block = large_block{};
+        free_large_objects.push_back(i);
+    }
+    large_bytes_limit = large_bytes + large_space_step;
+}
+
 unsigned allocate_byte_vector(unsigned count)
 {
+    if(count >= large_object_bytes)
+        return allocate_large(count,count);
     const unsigned id = allocate_cells(bodybytes_to_allcells(count));
     working_memory[id].car = number(count);
     return id;
@@ -114,26 +313,105 @@ unsigned allocate_byte_vector(unsigned count)
 
 unsigned allocate_vector(unsigned count)
 {
+    if(count*sizeof(lisp_object) >= large_object_bytes)
+        return allocate_large(count*sizeof(lisp_object),count);
     const unsigned id = allocate_cells(bodyobjects_to_allcells(count));
     working_memory[id].car = number(count);
     return id;
 }
 
+//Reservations
+/*
+    reserve_cells makes room for count cells, collecting at most once.
+    Until they are used up, reserved_cons and the allocate_ routines cannot collect,
+    so objects may be kept in C++ variables between these allocations.
+*/
+
+bool reserve_cells(unsigned count) //Returns true if it collected
+{
+    quantum_left -= count;
+    if(working_index + count < heap_cells && !large_space_full())
+        return false;
+    collect_garbage();
+    if(working_index + count >= heap_cells)
+        throw out_of_memory();
+    return true;
+}
+
+lisp_object reserved_cons(lisp_object car,lisp_object cdr) //No bounds check
+{
+    assert(working_index < heap_cells);
+    memory_cell& cell = working_memory[working_index];
+    cell.car = car;
+    cell.cdr = cdr;
+    return make_obj(cons_cell,working_index++);
+}
+
+unsigned string_cells(unsigned length) //Cells taken by allocate_byte_vector
+{
+    return length >= large_object_bytes ? 1 : bodybytes_to_allcells(length);
+}
+
+unsigned vector_cells(unsigned length) //Cells taken by allocate_vector
+{
+    return length*sizeof(lisp_object) >= large_object_bytes ? 1 : bodyobjects_to_allcells(length);
+}
+
+//Frame region
+/*
+    Frames of procedures the optimizer marked with %stack-frame are taken from the
+    frame region and released in LIFO order when the procedure returns.
+    The collector copies the region in place, so its cells never move.
+    A frame that turns out to be captured is copied to the heap by escape_frame.
+*/
+
+bool frame_room(unsigned count) //Green threads would interleave their frames
+{
+    return frame_index + count <= pool_size && live_threads == 1;
+}
+
+lisp_object frame_cons(lisp_object car,lisp_object cdr) //No bounds check, see frame_room
+{
+    memory_cell& cell = working_memory[frame_index];
+    cell.car = car;
+    cell.cdr = cdr;
+    return make_obj(cons_cell,frame_index++);
+}
+
+bool frame_regionp(lisp_object obj)
+{
+    return typep(obj,cons_cell) && obj.id >= heap_cells;
+}
+
+struct frame_mark //Releases the frames taken by a call, errors included
+{
+    const unsigned mark;
+    const bool used;
+    explicit frame_mark(bool used) : mark(frame_index), used(used) {}
+    ~frame_mark() { if(used) frame_index = mark; }
+};
+
 cons_cell deref_cons(lisp_object obj)
 {
-    assert(typep(obj,cons_cell) || typep(obj,compound) || typep(obj,lisp_vector) || typep(obj,lisp_string));
+    assert(typep(obj,cons_cell) || typep(obj,compound) || typep(obj,macro) || typep(obj,promise) ||
+           typep(obj,continuation) || typep(obj,future) || typep(obj,thread) || typep(obj,channel) || typep(obj,port) ||
+           typep(obj,lisp_vector) || typep(obj,record) || typep(obj,lisp_string));
     return static_cast<cons_cell>(working_memory[obj.id]);
 }
 
 lisp_object* deref_vector(lisp_object obj)
 {
-    assert(typep(obj,lisp_vector));
+    assert(typep(obj,lisp_vector) || typep(obj,record));
+    if(largep(obj.id))
+        return reinterpret_cast<lisp_object*>(large_objects[working_memory[obj.id].car.id].payload);
     return 1 + reinterpret_cast<lisp_object*>(working_memory + obj.id);
 }
 
 lisp_object vector_size(lisp_object obj)
 {
-    assert(typep(obj,lisp_vector) || typep(obj,lisp_string));
+    assert(typep(obj,lisp_vector) || typep(obj,record) || typep(obj,lisp_string));
+    if(largep(obj.id))
+        return deref_cons(obj).cdr;
     return deref_cons(obj).car;
 }
 
@@ -144,11 +422,13 @@ unsigned vector_length(lisp_object obj)
 
 lisp_object vector_get(lisp_object vector,unsigned index)
 {
-    deref_vector(vector)[index];
+    return deref_vector(vector)[index];
 }
 
 byte_t* deref_string(lisp_object string)
 {
+    if(largep(string.id))
+        return large_objects[working_memory[string.id].car.id].payload;
     return reinterpret_cast<byte_t*>(reinterpret_cast<lisp_object*>(working_memory + string.id) + 1);
 }
 
@@ -159,29 +439,58 @@ byte_t string_get(lisp_object string,unsigned index)
 
 lisp_object make_string(const unsigned length,const char* const content)
 {
-    unsigned adress = 0;
-    try {
-        adress = allocate_byte_vector(length);
-    } catch(out_of_memory()) {
-        collect_garbage();
-        adress = allocate_byte_vector(length);
-    }
+    reserve_cells(string_cells(length));
+    const unsigned adress = allocate_byte_vector(length);
     lisp_object res = make_obj(lisp_string,adress);
     char* lisp_adress = reinterpret_cast<char*>(deref_string(res));
     for(size_t i = 0;i < length;++i)
         lisp_adress[i] = content[i];
-    std::cout<<"\nObj adress is: "<<working_memory + adress<<"\nString adress is: "<<(void*)lisp_adress<<"\nLen is: "<<length<<'\n';
+    return res;
+}
+
+lisp_object make_substring(lisp_object str,unsigned start,unsigned length) //A slice when large enough
+{
+    push(str);
+    reserve_cells(string_cells(length));
+    pop(str);
+    if(length >= large_object_bytes && largep(str.id))
+        return make_obj(lisp_string,allocate_large_slice(str,start,length));
+    const lisp_object res = make_obj(lisp_string,allocate_byte_vector(length));
+    memcpy(deref_string(res),deref_string(str) + start,length);
     return res;
 }
 
 //Bignum arith
 static_assert(sizeof(int) == 4);
-const unsigned max_fixnum = 16777216 - 1; //2^24 - 1
-const unsigned max_fixnum_modulo = max_fixnum>>1;
+const object_word max_fixnum = (object_word(1) << object_id_bits) - 1; //2^24 - 1 or 2^46 - 1
+const object_word max_fixnum_modulo = max_fixnum>>1;
 const unsigned max_unsigned = 4294967296 - 1;//(2^32 - 1)
-const unsigned fixnum_negative_flag = 1<<23;
+const object_word fixnum_negative_flag = object_word(1) << (object_id_bits - 1);
 //const unsigned number_mask = max_unsigned-max_fixnum; //
 
+#ifdef LISP_NAN_BOXING
+lisp_object make_double_float(double value) //Inline, no allocation
+{
+    if(value != value)
+        value = __builtin_nan(""); //Positive quiet NaN
+    uint64_t bits;
+    memcpy(&bits,&value,sizeof(bits));
+    bits = ~bits;
+    lisp_object result;
+    memcpy(&result,&bits,sizeof(result));
+    return result;
+}
+
+double double_float_value(lisp_object obj)
+{
+    uint64_t bits;
+    memcpy(&bits,&obj,sizeof(bits));
+    bits = ~bits;
+    double value;
+    memcpy(&value,&bits,sizeof(value));
+    return value;
+}
+#else
 lisp_object make_double_float(long double value)
 {
     lisp_object result = make_obj(double_float, allocate_pair());
@@ -189,6 +498,7 @@ lisp_object make_double_float(long double value)
     *pointer = value;
     return result;
 }
+#endif
 
 lisp_object make_bignum(lisp_object bigger,lisp_object lower)
 {
@@ -202,21 +512,6 @@ unsigned fixnum_negate(unsigned num)
     return num|fixnum_negative_flag;
 }
 
-lisp_object add_fixnums(unsigned n1, unsigned n2)
-{
-    //TODO: Must use bitwise operations
-    unsigned res = n1 + n2;
-    unsigned overflow = res % max_fixnum;
-
-    if(overflow) { //Must be optimized
-
-        if (overflow == 1 && negative_fixnum(n1) && negative_fixnum(n2)) {
-            return make_bignum(number(overflow),number(underflow));
-        }
-        return make_bignum(number(overflow),number(underflow));
-    } else return make_obj(fixnum,res);
-}
-
 
 //Constants
 
@@ -232,39 +527,61 @@ const lisp_object sym_if = make_symbol("if");
 const lisp_object sym_define = make_symbol("define");
 const lisp_object sym_begin = make_symbol("begin");
 const lisp_object sym_let = make_symbol("let");
+const lisp_object sym_let_star = make_symbol("let*");
+const lisp_object sym_letrec = make_symbol("letrec");
+const lisp_object sym_letrec_star = make_symbol("letrec*");
+const lisp_object sym_cond = make_symbol("cond");
+const lisp_object sym_case = make_symbol("case");
+const lisp_object sym_and = make_symbol("and");
+const lisp_object sym_or = make_symbol("or");
+const lisp_object sym_when = make_symbol("when");
+const lisp_object sym_unless = make_symbol("unless");
+const lisp_object sym_else = make_symbol("else");
+const lisp_object sym_arrow = make_symbol("=>");
+const lisp_object sym_define_syntax = make_symbol("define-syntax");
+const lisp_object sym_syntax_rules = make_symbol("syntax-rules");
+const lisp_object sym_ellipsis = make_symbol("...");
+const lisp_object sym_underscore = make_symbol("_");
+const lisp_object sym_delay = make_symbol("delay");
+const lisp_object sym_cons_stream = make_symbol("cons-stream");
+const lisp_object sym_define_record_type = make_symbol("define-record-type");
+const lisp_object sym_closure = make_symbol("%closure");
+const lisp_object sym_unassigned = make_symbol("%unassigned");
+const lisp_object sym_stack_frame = make_symbol("%stack-frame");
+const lisp_object sym_unused_rest = make_symbol("%rest");
 
 
 //Stack
 
-lisp_object stack[1000];
-unsigned stack_pointer = 0;
+thread_local lisp_object stack[stack_size*stack_segments];
+thread_local unsigned stack_pointer = 0, stack_base = 0, stack_limit = stack_size;
 
 lisp_object stack_get(unsigned offset)
 {
     unsigned index = stack_pointer-offset-1;
-    assert(index >= 0 && index < 1000);
+    assert(index >= stack_base && index < stack_limit);
     return stack[index];
 }
 void stack_push(lisp_object val)
 {
     stack[stack_pointer++] = val;
-    assert(stack_pointer < 1000);
+    assert(stack_pointer < stack_limit);
 }
 lisp_object stack_pop(void)
 {
-    assert(stack_pointer > 0);
+    assert(stack_pointer > stack_base);
     return stack[--stack_pointer];
 }
 
 void stack_drop(unsigned count)
 {
     stack_pointer -= count;
-    assert(stack_pointer >= 0);
+    assert(stack_pointer >= stack_base);
 }
 
 void stack_set(unsigned count)
 {
-    stack_pointer = 1;
+    stack_pointer = count;
 }
 
 #define push(place) stack_push(place)
@@ -272,13 +589,23 @@ void stack_set(unsigned count)
 
 //Built-ins
 
+#ifdef LISP_NAN_BOXING
+lisp_object nil = {0,static_cast<object_word>(lisp_type::nil),0};
+lisp_object val_true = {1,static_cast<object_word>(lisp_type::boolean),0};
+lisp_object val_false = {0,static_cast<object_word>(lisp_type::boolean),0};
+#else
 lisp_object nil = {lisp_type::nil,0};
 lisp_object val_true = {lisp_type::boolean,1};
 lisp_object val_false = {lisp_type::boolean,0};
+#endif
 
 bool eq(lisp_object o1,lisp_object o2)
 {
+#ifdef LISP_NAN_BOXING
+    return o1.box == o2.box && o1.tag_bits == o2.tag_bits && o1.id == o2.id;
+#else
     return o1.tag == o2.tag && o1.id == o2.id;
+#endif
 }
 
 lisp_object add(lisp_object a1,lisp_object a2)
@@ -306,6 +633,8 @@ lisp_object div(lisp_object a1,lisp_object a2)
 {
     if(!(numberp (a1) && numberp(a2)))
         throw SimpleError("/: args must be numbers");
+    if(a2.id == 0)
+        throw SimpleError("/: division by zero");
     return number(a1.id/a2.id);
 }
 
@@ -313,6 +642,8 @@ unsigned allocate_pair_safe(lisp_object car,lisp_object cdr)
 {
     cons_cell* ptr = nullptr;
     try {
+        if(large_space_full())
+            throw out_of_memory(); //Collect to free large payloads
         ptr = working_memory + allocate_pair();
     } catch (out_of_memory ex) {
         push(car);
@@ -391,9 +722,7 @@ lisp_object trace_cell(const lisp_object obj) //Trace memory cell
     lisp_object res = obj;
     lisp_object* root = &res;
     while(!null(*root)) {
-        printf("Tracing ID %lu \n",root->id);
         if(broken_heartp(root->id)) {
-            printf("Found broken heart\n");
             root->id = deref_cons(*root).cdr.id;
             break;
         }
@@ -401,7 +730,6 @@ lisp_object trace_cell(const lisp_object obj) //Trace memory cell
         const cons_cell old_pair = deref_cons(*root);
         const memory_adress new_adress = free_index++;
         set_broken_heart(root->id,new_adress); //Must be before tracing to avoid infinite recursion
-        printf("New adress: %lu\n",deref_cons(*root).cdr.id);
         root->id = new_adress;
 
         lisp_object new_car = gc_trace(old_pair.car);
@@ -409,7 +737,7 @@ lisp_object trace_cell(const lisp_object obj) //Trace memory cell
         free_memory[new_adress].cdr = old_pair.cdr;
         root = &(free_memory[new_adress].cdr);
 
-        if(!typep((*root),cons_cell)) {
+        if(!typep((*root),cons_cell) || root->id >= heap_cells) {
             *root = gc_trace(*root);
             break;
         }
@@ -438,10 +766,29 @@ lisp_object trace_linear(const lisp_object obj) //Trace list of atoms (bignum, r
     return res;
 }
 
+lisp_object trace_large(lisp_object obj) //Only the header cell moves
+{
+    const unsigned new_adress = free_index++;
+    free_memory[new_adress] = working_memory[obj.id];
+    large_block& block = large_objects[working_memory[obj.id].car.id];
+    block.marked = true;
+    if(block.owner != no_owner)
+        large_objects[block.owner].marked = true;
+    set_broken_heart(obj.id,new_adress);
+    if(!typep(obj,lisp_string)) {
+        lisp_object* elements = reinterpret_cast<lisp_object*>(block.payload);
+        for(size_t i = 0;i < block.bytes/sizeof(lisp_object);++i)
+            elements[i] = gc_trace(elements[i]);
+    }
+    return make_lisp_object(object_type(obj),new_adress);
+}
+
 lisp_object trace_string(lisp_object str)
 {
     if(broken_heartp(str.id))
-        return lisp_object{str.tag,working_memory[str.id].cdr.id};
+        return make_lisp_object(object_type(str),working_memory[str.id].cdr.id);
+    if(largep(str.id))
+        return trace_large(str);
 
     const unsigned count = bodybytes_to_allcells(working_memory[str.id].car.id);
     const unsigned new_adress = free_index;
@@ -455,7 +802,9 @@ lisp_object trace_string(lisp_object str)
 lisp_object trace_vector(lisp_object obj)
 {
     if(broken_heartp(obj.id))
-        return lisp_object{obj.tag,working_memory[obj.id].cdr.id};
+        return make_lisp_object(object_type(obj),working_memory[obj.id].cdr.id);
+    if(largep(obj.id))
+        return trace_large(obj);
 
     const unsigned obj_len = deref_cons(obj).car.id;
     const unsigned len = bodyobjects_to_allcells(obj_len);
@@ -467,17 +816,30 @@ lisp_object trace_vector(lisp_object obj)
 
     free_index += len;
 
-    for(size_t i = 0;i <= obj_len;++i) {
-         *(new_ptr + i) = gc_trace(*(ptr + i)); //Head is replaced first.
-    }
+    for(size_t i = 0;i <= obj_len;++i)
+        new_ptr[i] = ptr[i];
+    set_broken_heart(obj.id,new_adress); //Before tracing, records may be cyclic
+    for(size_t i = 1;i <= obj_len;++i)
+        new_ptr[i] = gc_trace(new_ptr[i]);
 
-    return make_obj(lisp_vector,new_adress);
+    return make_lisp_object(object_type(obj),new_adress);
 }
 
-lisp_object gc_trace(lisp_object obj)
+void trace_frames(void) //Copied in place, then traced as roots
 {
+    std::copy(working_memory + heap_cells,working_memory + frame_index,free_memory + heap_cells);
+    for(size_t i = heap_cells;i < frame_index;++i) {
+        free_memory[i].car = gc_trace(free_memory[i].car);
+        free_memory[i].cdr = gc_trace(free_memory[i].cdr);
+    }
+}
 
-    if(typep(obj,cons_cell) || typep(obj,compound)) {
+lisp_object gc_trace(lisp_object obj)
+{
+    if(typep(obj,cons_cell) && obj.id >= heap_cells) //Frame region cells do not move
+        return obj;
+    if(typep(obj,cons_cell) || typep(obj,compound) || typep(obj,macro) || typep(obj,promise) || typep(obj,continuation) ||
+       typep(obj,future) || typep(obj,thread) || typep(obj,channel) || typep(obj,port)) {
         return trace_cell(obj);
     }
 
@@ -486,14 +848,14 @@ lisp_object gc_trace(lisp_object obj)
     }else if (typep(obj,lisp_string)) {
 
         return trace_string(obj);
-    } else if(typep(obj,lisp_vector))  {
+    } else if(typep(obj,lisp_vector) || typep(obj,record))  {
         return trace_vector(obj);
     } else {return obj;}
 }
 
 void gc_trace_stack(void)
 {
-    for(size_t i = 0;i < stack_pointer;++i)
+    for(size_t i = stack_base;i < stack_pointer;++i)
         stack[i] = gc_trace(stack[i]);
 }
 
@@ -509,11 +871,36 @@ void gc_end(void)
     free_memory = temp;
     working_index = free_index;
     free_index = 0;
-    printf("val: %lu, expr: %lu, env: %lu, global_env %lu",val.id,expr.id,env.id,global_environment.id);
+}
+
+//Statistics
+/*
+    Cells allocated in the heap (frame regions excluded), collections and the time spent in them,
+    for the benchmarks: main prints them at exit with --statistics.
+*/
+
+thread_local unsigned long long allocated_before = 0, collections = 0;
+thread_local unsigned allocation_start = 0; //working_index after the last collection or image load
+thread_local std::chrono::steady_clock::duration collection_time{};
+
+unsigned long long allocated_cells(void)
+{
+    return allocated_before + (working_index - allocation_start);
+}
+
+void print_statistics(FILE* out,std::chrono::steady_clock::duration wall_time)
+{
+    using std::chrono::microseconds;
+    using std::chrono::duration_cast;
+    fprintf(out,"wall_ms=%.3f allocated_cells=%llu collections=%llu gc_ms=%.3f\n",
+            duration_cast<microseconds>(wall_time).count() / 1000.0,allocated_cells(),collections,
+            duration_cast<microseconds>(collection_time).count() / 1000.0);
 }
 
 void collect_garbage(void)
 {
+    const auto start = std::chrono::steady_clock::now();
+    allocated_before += working_index - allocation_start;
     gc_start();
     val = gc_trace(val);
     expr = gc_trace(expr);
@@ -522,8 +909,427 @@ void collect_garbage(void)
     unev = gc_trace(unev);
     proc = gc_trace(proc);
     global_environment = gc_trace(global_environment); //Must be always broken-heart
+    redefined_primitives = gc_trace(redefined_primitives);
     gc_trace_stack();
+    gc_trace_threads();
+    gc_trace_handles();
+    trace_frames();
+    jit_collect();
+    gc_trace_inline_patches(); //Weak, last
+    gc_sweep_ports(); //Reaches nothing more
     gc_end();
+    sweep_large_objects();
+    allocation_start = working_index;
+    ++collections;
+    collection_time += std::chrono::steady_clock::now() - start;
+}
+
+void init_isolate_memory(void) //Worker isolates get their own pools and stack
+{
+#ifdef LISP_NAN_BOXING
+    working_memory = allocate_pool();
+    free_memory = allocate_pool();
+#else
+    working_memory = new memory_cell[pool_size];
+    free_memory = new memory_cell[pool_size];
+#endif
+    working_index = free_index = 0;
+    frame_index = heap_cells;
+    stack_pointer = stack_base = 0;
+    stack_limit = stack_size;
+}
+
+//Messages
+/*
+    Objects are copied between isolate heaps through a message: a flat array of cells
+    laid out as the gc_trace routines would lay them out in free_memory.
+    Cell 0 holds the root and the alist of global bindings referenced by the root.
+    Source cells are not broken, a forwarding table keeps sharing and cycles.
+*/
+
+const lisp_object global_marker = make_obj(broken_heart,1); //Stands for the global environment of an isolate
+
+thread_local const memory_cell *copy_source;
+thread_local message *copy_target;
+thread_local unsigned copy_base;
+thread_local lisp_object copy_global_from, copy_global_to;
+thread_local std::unordered_map<unsigned,unsigned> copy_forward;
+thread_local std::unordered_set<unsigned> copy_symbols;
+thread_local bool copy_globals;
+thread_local std::vector<unsigned>* copy_symbols_out; //Symbols are written as indices into this table
+thread_local const std::vector<unsigned>* copy_symbols_in;
+thread_local std::unordered_map<unsigned,unsigned> copy_symbol_index;
+
+lisp_object copy_trace(lisp_object);
+
+unsigned copy_allocate(unsigned count)
+{
+    const unsigned index = copy_target->size();
+    copy_target->resize(index + count);
+    return index;
+}
+
+lisp_object copy_forwarded(lisp_object obj,bool* found)
+{
+    auto adress = copy_forward.find(obj.id);
+    *found = adress != copy_forward.end();
+    return *found ? make_lisp_object(object_type(obj),adress->second) : obj;
+}
+
+lisp_object copy_cell(const lisp_object obj) //trace_cell without broken hearts
+{
+    lisp_object res = obj;
+    long link = -1; //Cell of the target whose cdr is copied now
+    lisp_object current = obj;
+    while(true) {
+        bool found = false;
+        lisp_object copied = eq(current,copy_global_from) ? copy_global_to : copy_forwarded(current,&found);
+        if(!found && !eq(current,copy_global_from)) {
+            const unsigned index = copy_allocate(1);
+            copy_forward[current.id] = copy_base + index;
+            copied = make_lisp_object(object_type(current),copy_base + index);
+        }
+        if(link == -1)
+            res = copied;
+        else (*copy_target)[link].cdr = copied;
+        if(found || eq(current,copy_global_from))
+            break;
+
+        const cons_cell old_pair = copy_source[current.id];
+        link = copied.id - copy_base;
+        lisp_object new_car = copy_trace(old_pair.car);
+        (*copy_target)[link].car = new_car;
+        current = old_pair.cdr;
+        if(!typep(current,cons_cell)) {
+            lisp_object new_cdr = copy_trace(current);
+            (*copy_target)[link].cdr = new_cdr;
+            break;
+        }
+    }
+    return res;
+}
+
+lisp_object copy_string(lisp_object str)
+{
+    bool found = false;
+    lisp_object res = copy_forwarded(str,&found);
+    if(found)
+        return res;
+
+    if(typep(copy_source[str.id].car,large)) { //Sent as an ordinary string
+        const large_block& block = large_objects[copy_source[str.id].car.id];
+        const unsigned index = copy_allocate(bodybytes_to_allcells(block.bytes));
+        (*copy_target)[index].car = number(static_cast<unsigned>(block.bytes));
+        std::copy(block.payload,block.payload + block.bytes,reinterpret_cast<byte_t*>(copy_target->data() + index) + sizeof(lisp_object));
+        copy_forward[str.id] = copy_base + index;
+        return make_obj(lisp_string,copy_base + index);
+    }
+    const unsigned count = bodybytes_to_allcells(copy_source[str.id].car.id);
+    const unsigned index = copy_allocate(count);
+    for(size_t i = 0;i < count;++i)
+        (*copy_target)[index + i] = copy_source[str.id + i];
+    copy_forward[str.id] = copy_base + index;
+    return make_obj(lisp_string,copy_base + index);
+}
+
+lisp_object copy_vector(lisp_object obj)
+{
+    bool found = false;
+    lisp_object res = copy_forwarded(obj,&found);
+    if(found)
+        return res;
+
+    const bool large_vector = typep(copy_source[obj.id].car,large); //Sent as an ordinary vector
+    const unsigned obj_len = large_vector ? copy_source[obj.id].cdr.id : copy_source[obj.id].car.id;
+    const unsigned index = copy_allocate(bodyobjects_to_allcells(obj_len));
+    copy_forward[obj.id] = copy_base + index;
+
+    const lisp_object *elements = large_vector ?
+        reinterpret_cast<const lisp_object*>(large_objects[copy_source[obj.id].car.id].payload) :
+        reinterpret_cast<const lisp_object*>(copy_source + obj.id) + 1;
+    reinterpret_cast<lisp_object*>(copy_target->data() + index)[0] = number(obj_len);
+    for(size_t i = 1;i <= obj_len;++i) {
+        lisp_object element = copy_trace(elements[i - 1]);
+        reinterpret_cast<lisp_object*>(copy_target->data() + index)[i] = element; //Target may be reallocated
+    }
+    return make_lisp_object(object_type(obj),copy_base + index);
+}
+
+lisp_object copy_symbol(lisp_object sym)
+{
+    if(copy_symbols_in)
+        return make_obj(symbol,copy_symbols_in->at(sym.id));
+    auto index = copy_symbol_index.find(sym.id);
+    if(index != copy_symbol_index.end())
+        return make_obj(symbol,index->second);
+    copy_symbols_out->push_back(sym.id);
+    copy_symbol_index[sym.id] = copy_symbols_out->size() - 1;
+    return make_obj(symbol,copy_symbols_out->size() - 1);
+}
+
+lisp_object copy_trace(lisp_object obj)
+{
+    if(eq(obj,copy_global_from))
+        return copy_global_to;
+    if(copy_globals && typep(obj,symbol))
+        copy_symbols.insert(obj.id);
+    if((copy_symbols_in || copy_symbols_out) && typep(obj,symbol))
+        return copy_symbol(obj);
+
+    if(typep(obj,cons_cell) || typep(obj,compound) || typep(obj,macro) || typep(obj,promise) || typep(obj,future) ||
+       typep(obj,thread) || typep(obj,channel) || typep(obj,bignum) || typep(obj,real)) {
+        return copy_cell(obj);
+    } else if (typep(obj,lisp_string)) {
+        return copy_string(obj);
+    } else if(typep(obj,lisp_vector) || typep(obj,record))  {
+        return copy_vector(obj);
+    } else if(typep(obj,continuation)) { //Escapes only within its isolate, sent dead
+        const unsigned index = copy_allocate(1);
+        (*copy_target)[index].car = val_false;
+        (*copy_target)[index].cdr = nil;
+        return make_obj(continuation,copy_base + index);
+    } else if(typep(obj,port)) { //Its descriptor belongs to this isolate, sent closed
+        const unsigned index = copy_allocate(1);
+        (*copy_target)[index].car = val_false;
+        (*copy_target)[index].cdr = nil;
+        return make_obj(port,copy_base + index);
+    } else {return obj;}
+}
+
+void message_begin(message& msg,bool with_globals,std::vector<unsigned>* symbols)
+{
+    msg.assign(1,memory_cell{nil,nil});
+    copy_source = working_memory;
+    copy_target = &msg;
+    copy_base = 0;
+    copy_global_from = global_environment;
+    copy_global_to = global_marker;
+    copy_forward.clear();
+    copy_symbols.clear();
+    copy_globals = with_globals;
+    copy_symbols_out = symbols;
+    copy_symbols_in = nullptr;
+    copy_symbol_index.clear();
+}
+
+lisp_object message_copy(lisp_object obj)
+{
+    return copy_trace(obj);
+}
+
+lisp_object message_cons(lisp_object car,lisp_object cdr)
+{
+    const unsigned index = copy_allocate(1);
+    (*copy_target)[index].car = car;
+    (*copy_target)[index].cdr = cdr;
+    return make_obj(cons_cell,index);
+}
+
+void message_end(lisp_object root) //Appends the global bindings the copied code may refer to
+{
+    lisp_object globals = nil;
+    std::unordered_set<unsigned> done;
+    while(copy_globals && done.size() != copy_symbols.size()) {
+        std::vector<unsigned> pending;
+        for(unsigned id : copy_symbols)
+            if(done.insert(id).second)
+                pending.push_back(id);
+        for(unsigned id : pending) {
+            lisp_object binding = assoc(make_obj(symbol,id),car(global_environment.id));
+            if(null(binding))
+                continue;
+            lisp_object value = copy_trace(cdr(binding.id));
+            globals = message_cons(message_cons(make_obj(symbol,id),value),globals);
+        }
+    }
+    (*copy_target)[0].car = root;
+    (*copy_target)[0].cdr = globals;
+    copy_forward.clear();
+    copy_symbols.clear();
+}
+
+lisp_object receive_message(const message& msg,const std::vector<unsigned>* symbols) //Copies the message into this isolate, defines its globals
+{
+    message cells;
+    copy_source = msg.data();
+    copy_target = &cells;
+    copy_global_from = global_marker;
+    copy_global_to = global_environment;
+    copy_forward.clear();
+    copy_globals = false;
+    copy_symbols_in = symbols;
+    copy_symbols_out = nullptr;
+
+    unsigned globals_count = 0;
+    for(lisp_object current = msg[0].cdr;!null(current);current = msg[current.id].cdr)
+        ++globals_count;
+    reserve_cells(msg.size() + 2*globals_count); //No collection may happen below: raw objects are kept
+    copy_base = allocate_cells(msg.size());
+    const lisp_object root = copy_trace(msg[0].car);
+    lisp_object globals = copy_trace(msg[0].cdr);
+    copy_forward.clear();
+    std::copy(cells.begin(),cells.end(),working_memory + copy_base);
+
+    const lisp_object saved_env = env;
+    env = global_environment;
+    for(;!null(globals);globals = cdr(globals.id))
+        extend_environment(car(car(globals.id).id),cdr(car(globals.id).id));
+    env = saved_env;
+    return root;
+}
+
+//Image
+/*
+    Image file: header, symbol names, heap cells from image_alignment.
+    The heap is index-addressed, so it is mapped back into first_pool without relocation.
+*/
+
+struct image_header
+{
+    char magic[8];
+    unsigned cells;
+    unsigned symbols;
+    unsigned symbols_bytes;
+    unsigned primitives;
+    lisp_object global_environment;
+    lisp_object inline_patches;
+    lisp_object redefined_primitives;
+    unsigned large_objects; //Live ones, written after the heap
+    unsigned large_slots;
+};
+
+struct large_image_entry
+{
+    unsigned index;
+    unsigned bytes;
+};
+
+#ifdef LISP_NAN_BOXING
+const char image_magic[8] = {'L','I','S','P','I','M','W','3'}; //64-bit cells
+#else
+const char image_magic[8] = {'L','I','S','P','I','M','G','3'};
+#endif
+
+unsigned primitives_count(void);
+
+void save_image(const char* path)
+{
+    collect_garbage();
+    FILE* file = fopen(path,"wb");
+    if(!file)
+        throw SimpleError("save-image: cannot open file");
+
+    image_header header = {};
+    std::copy(image_magic,image_magic + 8,header.magic);
+    header.cells = working_index;
+    header.symbols = obarray.size();
+    for(symbol name : obarray)
+        header.symbols_bytes += strlen(name) + 1;
+    header.primitives = primitives_count();
+    header.global_environment = global_environment;
+    header.inline_patches = inline_patches;
+    header.redefined_primitives = redefined_primitives;
+    header.large_slots = large_objects.size();
+    for(const large_block& block : large_objects)
+        header.large_objects += block.payload != nullptr;
+
+    bool written = fwrite(&header,sizeof(header),1,file) == 1;
+    for(symbol name : obarray)
+        written = written && fwrite(name,strlen(name) + 1,1,file) == 1;
+    const long padding = image_alignment - ftell(file) % image_alignment;
+    for(long i = 0;i < padding;++i)
+        written = written && fputc(0,file) != EOF;
+    written = written && fwrite(working_memory,sizeof(memory_cell),working_index,file) == working_index;
+    for(size_t i = 0;i < large_objects.size();++i) {
+        if(!large_objects[i].payload)
+            continue;
+        const large_image_entry entry = {static_cast<unsigned>(i),static_cast<unsigned>(large_objects[i].bytes)};
+        written = written && fwrite(&entry,sizeof(entry),1,file) == 1 &&
+                  fwrite(large_objects[i].payload,1,entry.bytes,file) == entry.bytes;
+    }
+    if(fclose(file) != 0 || !written)
+        throw SimpleError("save-image: write failed");
+}
+
+void load_image(const char* path) //Replaces init_global_env
+{
+    const int fd = open(path,O_RDONLY);
+    if(fd == -1)
+        throw SimpleError("image: cannot open file");
+    image_header header;
+    std::vector<char> names;
+    bool valid = ::read(fd,&header,sizeof(header)) == sizeof(header) &&
+                 std::equal(image_magic,image_magic + 8,header.magic) &&
+                 header.primitives == primitives_count() && header.cells < heap_cells;
+    if(valid) {
+        names.resize(header.symbols_bytes);
+        valid = ::read(fd,names.data(),names.size()) == (ssize_t)names.size();
+    }
+    if(!valid) {
+        close(fd);
+        throw SimpleError("image: invalid file");
+    }
+
+    //Symbols interned at startup must keep their ids
+    std::vector<symbol> image_obarray;
+    for(size_t offset = 0;offset < names.size();offset += strlen(&names[offset]) + 1)
+        image_obarray.push_back(&names[offset]);
+    for(size_t i = 0;i < obarray.size();++i) {
+        if(i >= image_obarray.size() || !same_strings(obarray[i],image_obarray[i])) {
+            close(fd);
+            throw SimpleError("image: saved by another interpreter build");
+        }
+    }
+    for(size_t i = obarray.size();i < image_obarray.size();++i) {
+        char* name = new char[strlen(image_obarray[i]) + 1];
+        strcpy(name,image_obarray[i]);
+        obarray.push_back(name);
+    }
+
+    const off_t heap_offset = ((sizeof(header) + header.symbols_bytes) / image_alignment + 1) * image_alignment;
+    const size_t heap_bytes = header.cells * sizeof(memory_cell);
+    working_memory = first_pool;
+    free_memory = second_pool;
+    if(heap_bytes && mmap(first_pool,heap_bytes,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_FIXED,fd,heap_offset) == MAP_FAILED) {
+        if(pread(fd,first_pool,heap_bytes,heap_offset) != (ssize_t)heap_bytes) {
+            close(fd);
+            throw SimpleError("image: cannot read heap");
+        }
+    }
+
+    for(large_block& block : large_objects)
+        delete[] block.payload;
+    large_objects.assign(header.large_slots,large_block{});
+    free_large_objects.clear();
+    large_bytes = 0;
+    off_t offset = heap_offset + heap_bytes;
+    for(unsigned i = 0;i < header.large_objects;++i) {
+        large_image_entry entry;
+        bool valid = pread(fd,&entry,sizeof(entry),offset) == sizeof(entry) && entry.index < header.large_slots;
+        byte_t* payload = valid ? new byte_t[entry.bytes] : nullptr;
+        valid = valid && pread(fd,payload,entry.bytes,offset + sizeof(entry)) == (ssize_t)entry.bytes;
+        if(!valid) {
+            delete[] payload;
+            close(fd);
+            throw SimpleError("image: cannot read large objects");
+        }
+        large_objects[entry.index] = large_block{payload,entry.bytes,false};
+        large_bytes += entry.bytes;
+        offset += sizeof(entry) + entry.bytes;
+    }
+    for(unsigned i = 0;i < header.large_slots;++i)
+        if(!large_objects[i].payload)
+            free_large_objects.push_back(i);
+    large_bytes_limit = large_bytes + large_space_step;
+    close(fd);
+
+    working_index = allocation_start = header.cells;
+    free_index = 0;
+    global_environment = header.global_environment;
+    inline_patches = header.inline_patches;
+    redefined_primitives = header.redefined_primitives;
+    val = expr = argl = proc = unev = nil;
+    env = global_environment;
 }
 
 //Primitives
@@ -598,6 +1404,55 @@ void prim_div(unsigned num)
         val = div(val,stack_get(i));
 }
 
+long long fixnum_value(lisp_object obj) //Signed, the id bits are two's complement
+{
+    if(obj.id & fixnum_negative_flag)
+        return static_cast<long long>(obj.id) - static_cast<long long>(max_fixnum) - 1;
+    return static_cast<long long>(obj.id);
+}
+
+template<class relation>
+void compare_numbers(unsigned num,relation holds,const char* msg) //Holds between each pair of neighbours
+{
+    if(num == 0)
+        throw SimpleError(msg);
+    for(unsigned i = 0;i < num;++i)
+        if(!numberp(stack_get(i)))
+            throw SimpleError(msg);
+    val = val_true;
+    for(unsigned i = num - 1;i > 0;--i) {
+        if(!holds(fixnum_value(stack_get(i)),fixnum_value(stack_get(i - 1)))) {
+            val = val_false;
+            return;
+        }
+    }
+}
+
+void prim_less(unsigned num)
+{
+    compare_numbers(num,std::less<long long>(),"<: args must be numbers");
+}
+
+void prim_greater(unsigned num)
+{
+    compare_numbers(num,std::greater<long long>(),">: args must be numbers");
+}
+
+void prim_less_equal(unsigned num)
+{
+    compare_numbers(num,std::less_equal<long long>(),"<=: args must be numbers");
+}
+
+void prim_greater_equal(unsigned num)
+{
+    compare_numbers(num,std::greater_equal<long long>(),">=: args must be numbers");
+}
+
+void prim_number_equal(unsigned num)
+{
+    compare_numbers(num,std::equal_to<long long>(),"=: args must be numbers");
+}
+
 void prim_car(unsigned num)
 {
     if ((num != 1) || !typep(stack_get(0),cons_cell))
@@ -619,11 +1474,52 @@ void prim_null(unsigned num)
     val = make_obj(boolean,static_cast<unsigned>(null(stack_get(0))));
 }
 
+void prim_force(unsigned num)
+{
+    if (num != 1)
+        throw SimpleError("force: invalid args count");
+    val = stack_get(0);
+    force_promise();
+}
+
+void prim_stream_car(unsigned num)
+{
+    if ((num != 1) || !(typep(stack_get(0),cons_cell)))
+        throw SimpleError("stream-car: one arg of type pair awaited");
+    val = car(stack_get(0).id);
+}
+
+void prim_stream_cdr(unsigned num)
+{
+    if ((num != 1) || !(typep(stack_get(0),cons_cell)))
+        throw SimpleError("stream-cdr: one arg of type pair awaited");
+    val = cdr(stack_get(0).id);
+    force_promise();
+}
+
 void prim_list(unsigned num)
 {
+    reserve_cells(num);
     val = nil;
     for(unsigned i = 0;i < num;++i)
-        val = cons(stack_get(i),val);
+        val = reserved_cons(stack_get(i),val);
+}
+
+void prim_apply(unsigned num) //(apply procedure arg ... list), the list is spread on the stack
+{
+    if(num < 2)
+        throw SimpleError("apply: procedure and argument list awaited");
+    const unsigned at = stack_pointer - num;
+    const unsigned argc = num - 2 + list_length(stack_get(0),"apply: last arg must be proper list");
+    if(stack_pointer + argc + 1 >= stack_limit)
+        throw SimpleError("apply: too many args");
+    push(unev);
+    for(unsigned i = at + 1;i < at + num - 1;++i)
+        push(stack[i]);
+    for(lisp_object arg = stack[at + num - 1];!null(arg);arg = cdr(arg.id))
+        push(car(arg.id));
+    proc = stack[at];
+    apply_procedure(argc);
 }
 
 void prim_set_car(unsigned num)
@@ -643,7 +1539,7 @@ void prim_set_cdr(unsigned num)
 void prim_vector_length(unsigned num)
 {
     assert_count(1,vector-length);
-    val = deref_cons(stack_get(0)).car;
+    val = vector_size(stack_get(0));
 }
 
 void prim_string_ref(unsigned num)
@@ -668,14 +1564,25 @@ void prim_vector(unsigned num)
     if(len < 1) {
         throw SimpleError("Vector: must be called with arguments");
     }
+    reserve_cells(vector_cells(len));
     unsigned id = allocate_vector(len);
-    lisp_object *ptr = reinterpret_cast<lisp_object*>(working_memory + id) + 1;
+    lisp_object *ptr = deref_vector(make_obj(lisp_vector,id));
     for(int i = len-1;i >= 0;--i) {
         *(ptr++) = stack_get(i);
     }
     val = make_obj(lisp_vector,id);
 }
 
+void prim_save_image(unsigned num)
+{
+    if(num != 1 || !typep(stack_get(0),lisp_string))
+        throw SimpleError("save-image: file name awaited");
+    const unsigned len = vector_length(stack_get(0));
+    std::string path(reinterpret_cast<char*>(deref_string(stack_get(0))),len);
+    save_image(path.c_str());
+    val = val_true;
+}
+
 void prim_vector_ref(unsigned num)
 {
     assert_count(2,"vector-ref");
@@ -687,6 +1594,79 @@ void prim_vector_ref(unsigned num)
     val = deref_vector(vec)[index.id];
 }
 
+void prim_make_vector(unsigned num) //(make-vector length [fill])
+{
+    if(num < 1 || num > 2 || !typep(stack_get(num - 1),fixnum) || stack_get(num - 1).id == 0)
+        throw SimpleError("make-vector: positive length awaited");
+    const unsigned len = stack_get(num - 1).id;
+    reserve_cells(vector_cells(len));
+    const unsigned id = allocate_vector(len);
+    const lisp_object fill = num == 2 ? stack_get(0) : val_false;
+    std::fill(deref_vector(make_obj(lisp_vector,id)),deref_vector(make_obj(lisp_vector,id)) + len,fill);
+    val = make_obj(lisp_vector,id);
+}
+
+void prim_vector_set(unsigned num)
+{
+    assert_count(3,vector-set!);
+    const lisp_object vec = stack_get(2);
+    const lisp_object index = stack_get(1);
+    if(!typep(vec,lisp_vector) || !typep(index,fixnum) || index.id >= vector_length(vec))
+        throw SimpleError("vector-set!: invalid call");
+    deref_vector(vec)[index.id] = stack_get(0);
+    val = stack_get(0);
+}
+
+//Records
+/*
+    A record is laid out as a vector block: length, type descriptor, fields.
+    The descriptor is the (name . fields) list made by define-record-type,
+    so one tag check and one eq? on it identify the type.
+*/
+
+lisp_object* checked_record(lisp_object obj,lisp_object type,lisp_object index,const char* msg)
+{
+    if(!typep(obj,record) || !eq(deref_vector(obj)[0],type) || !typep(index,fixnum) ||
+       fixnum_value(index) < 0 || fixnum_value(index) + 1 >= static_cast<long long>(vector_length(obj)))
+        throw SimpleError(msg);
+    return deref_vector(obj);
+}
+
+void prim_make_record(unsigned num) //(%make-record type field ...)
+{
+    if(num < 1 || !typep(stack_get(num - 1),cons_cell))
+        throw SimpleError("record: type descriptor awaited");
+    reserve_cells(vector_cells(num));
+    const unsigned id = allocate_vector(num);
+    lisp_object* fields = deref_vector(make_obj(record,id));
+    for(int i = num - 1;i >= 0;--i)
+        *(fields++) = stack_get(i);
+    val = make_obj(record,id);
+}
+
+void prim_recordp(unsigned num) //(%record? obj type)
+{
+    if(num != 2)
+        throw SimpleError("record predicate: invalid args count");
+    const lisp_object obj = stack_get(1);
+    val = make_obj(boolean,static_cast<unsigned>(typep(obj,record) && eq(deref_vector(obj)[0],stack_get(0))));
+}
+
+void prim_record_ref(unsigned num) //(%record-ref obj type index)
+{
+    if(num != 3)
+        throw SimpleError("record accessor: invalid args count");
+    val = checked_record(stack_get(2),stack_get(1),stack_get(0),"record accessor: record of another type")[1 + stack_get(0).id];
+}
+
+void prim_record_set(unsigned num) //(%record-set! obj type index value)
+{
+    if(num != 4)
+        throw SimpleError("record modifier: invalid args count");
+    checked_record(stack_get(3),stack_get(2),stack_get(1),"record modifier: record of another type")[1 + stack_get(1).id] = stack_get(0);
+    val = stack_get(0);
+}
+
 #define prim_proc(name,adress) {make_symbol(name),adress}
 
 built_in primitive_procedures[] =
@@ -697,9 +1677,18 @@ built_in primitive_procedures[] =
     prim_proc("-",prim_sub),
     prim_proc("*",prim_mul),
     prim_proc("/",prim_div),
+    prim_proc("<",prim_less),
+    prim_proc(">",prim_greater),
+    prim_proc("<=",prim_less_equal),
+    prim_proc(">=",prim_greater_equal),
+    prim_proc("=",prim_number_equal),
     prim_proc("eq?",prim_eq),
+    prim_proc("eqv?",prim_eqv),
+    prim_proc("equal?",prim_equal),
+    prim_proc("equal-hash",prim_equal_hash),
     prim_proc("null?",prim_null),
     prim_proc("list",prim_list),
+    prim_proc("apply",prim_apply),
     prim_proc("gc",prim_gc),
     prim_proc("length",prim_length),
     prim_proc("set-car!",prim_set_car),
@@ -707,12 +1696,146 @@ built_in primitive_procedures[] =
     prim_proc("vector-length",prim_vector_length),
     prim_proc("string-char",prim_string_ref),
     prim_proc("vector",prim_vector),
-    prim_proc("vector-ref",prim_vector_ref)};
+    prim_proc("vector-ref",prim_vector_ref),
+    prim_proc("make-vector",prim_make_vector),
+    prim_proc("vector-set!",prim_vector_set),
+    prim_proc("save-image",prim_save_image),
+    prim_proc("load",prim_load),
+    prim_proc("parallel-map",prim_parallel_map),
+    prim_proc("future",prim_future),
+    prim_proc("touch",prim_touch),
+    prim_proc("jit-threshold",prim_jit_threshold),
+    prim_proc("spawn",prim_spawn),
+    prim_proc("yield",prim_yield),
+    prim_proc("join",prim_join),
+    prim_proc("make-channel",prim_make_channel),
+    prim_proc("channel-send",prim_channel_send),
+    prim_proc("channel-receive",prim_channel_receive),
+    prim_proc("thread-quantum",prim_thread_quantum),
+    prim_proc("open-input-file",prim_open_input_file),
+    prim_proc("open-output-file",prim_open_output_file),
+    prim_proc("unix-listen",prim_unix_listen),
+    prim_proc("unix-connect",prim_unix_connect),
+    prim_proc("tcp-listen",prim_tcp_listen),
+    prim_proc("tcp-connect",prim_tcp_connect),
+    prim_proc("accept",prim_accept),
+    prim_proc("read-string",prim_read_string),
+    prim_proc("read-line",prim_read_line),
+    prim_proc("write-string",prim_write_string),
+    prim_proc("close-port",prim_close_port),
+    prim_proc("open-output-string",prim_open_output_string),
+    prim_proc("get-output-string",prim_get_output_string),
+    prim_proc("string-append",prim_string_append),
+    prim_proc("substring",prim_substring),
+    prim_proc("string->symbol",prim_string_to_symbol),
+    prim_proc("symbol->string",prim_symbol_to_string),
+    prim_proc("number->string",prim_number_to_string),
+    prim_proc("append",prim_append),
+    prim_proc("reverse",prim_reverse),
+    prim_proc("map",prim_map),
+    prim_proc("for-each",prim_for_each),
+    prim_proc("filter",prim_filter),
+    prim_proc("fold-left",prim_fold_left),
+    prim_proc("fold-right",prim_fold_right),
+    prim_proc("assq",prim_assq),
+    prim_proc("assoc",prim_assoc),
+    prim_proc("memq",prim_memq),
+    prim_proc("member",prim_member),
+    prim_proc("list-tail",prim_list_tail),
+    prim_proc("list-ref",prim_list_ref),
+    prim_proc("sort",prim_sort),
+    prim_proc("sort!",prim_sort_in_place),
+    prim_proc("call/cc",prim_call_cc),
+    prim_proc("call-with-current-continuation",prim_call_cc),
+    prim_proc("dynamic-wind",prim_dynamic_wind),
+    prim_proc("load-extension",prim_load_extension),
+    prim_proc("make-byte-string",prim_make_byte_string),
+    prim_proc("string-byte-ref",prim_string_byte_ref),
+    prim_proc("string-byte-set!",prim_string_byte_set),
+    prim_proc("force",prim_force),
+    prim_proc("stream-car",prim_stream_car),
+    prim_proc("stream-cdr",prim_stream_cdr),
+    prim_proc("%make-record",prim_make_record),
+    prim_proc("%record?",prim_recordp),
+    prim_proc("%record-ref",prim_record_ref),
+    prim_proc("%record-set!",prim_record_set)};
+
+const unsigned builtins_count = sizeof(primitive_procedures)/sizeof(built_in);
+
+//Native primitives registered at run time follow the built-ins
+/*
+    Registered before isolates start, the table is then only read.
+    Its capacity is reserved so that entries never move.
+*/
+const unsigned max_native_primitives = 256;
+std::vector<built_in> native_procedures;
+
+unsigned primitives_count(void)
+{
+    return builtins_count + native_procedures.size();
+}
+
+const built_in& primitive_entry(unsigned index)
+{
+    return index < builtins_count ? primitive_procedures[index] : native_procedures[index - builtins_count];
+}
+
+lisp_object find_primitive(const char* name)
+{
+    for(size_t i = 0;i != primitives_count();++i)
+        if(same_strings(get_symbol(primitive_entry(i).symbol.id),name))
+            return make_obj(primitive,i);
+    throw SimpleError("Unknown primitive");
+}
+
+int primitive_index(lisp_object sym) //-1 if sym does not name a primitive
+{
+    for(size_t i = 0;i != primitives_count();++i)
+        if(eq(primitive_entry(i).symbol,sym))
+            return i;
+    return -1;
+}
 
 primitive_procedure primitive_adress(lisp_object proc)
 {
     assert(typep(proc,primitive));
-    return primitive_procedures[proc.id].adress;
+    return primitive_entry(proc.id).adress;
+}
+
+void check_arity(lisp_object proc,unsigned argc) //Built-ins check their args themselves
+{
+    if(proc.id < builtins_count)
+        return;
+    const built_in& entry = native_procedures[proc.id - builtins_count];
+    if(argc < static_cast<unsigned>(entry.min_args) || (entry.max_args != -1 && argc > static_cast<unsigned>(entry.max_args)))
+        throw SimpleError("native primitive: wrong number of args");
+}
+
+void define_primitive(const char* name,primitive_procedure adress,int min_args,int max_args)
+{
+    if(min_args < 0 || (max_args != -1 && max_args < min_args))
+        throw SimpleError("define-primitive: invalid arity");
+    if(symbol_id(name) != -1 && primitive_index(make_obj(symbol,symbol_id(name))) != -1)
+        throw SimpleError("define-primitive: name already taken");
+    if(native_procedures.size() == max_native_primitives)
+        throw SimpleError("define-primitive: too many primitives");
+    native_procedures.reserve(max_native_primitives);
+    lisp_object sym = make_obj(symbol,symbol_id(name));
+    if(symbol_id(name) == -1) {
+        char* new_location = new char[strlen(name) + 1];
+        strcpy(new_location,name);
+        sym = make_symbol(new_location);
+    }
+    native_procedures.push_back(built_in{sym,adress,min_args,max_args});
+    const lisp_object prim = make_obj(primitive,primitives_count() - 1);
+    const lisp_object binding = assoc(sym,car(global_environment.id));
+    if(!null(binding)) {
+        set_cdr(binding.id,prim);
+    } else {
+        lisp_object temp = cons(sym,prim);
+        lisp_object bindings = cons(temp,car(global_environment.id));
+        set_car(global_environment.id,bindings);
+    }
 }
 
 //Environment
@@ -729,32 +1852,88 @@ lisp_object assoc(const lisp_object sym,const lisp_object alist)
     return nil;
 }
 
+void escape_frame(void) //env is about to be kept by a heap object, a region frame moves to the heap
+{
+    if(!frame_regionp(env))
+        return;
+    const lisp_object frame = env; //Region cells do not move
+    reserve_cells(2*length(car(frame.id)) + 1);
+    lisp_object bindings = nil;
+    for(lisp_object current = car(frame.id);!null(current);current = cdr(current.id)) {
+        const lisp_object binding = car(current.id);
+        bindings = reserved_cons(frame_regionp(binding) ? reserved_cons(car(binding.id),cdr(binding.id)) : binding,bindings);
+    }
+    env = reserved_cons(bindings,cdr(frame.id));
+    for(unsigned i = stack_base;i < stack_pointer;++i) //Saved copies of env
+        if(eq(stack[i],frame))
+            stack[i] = env;
+}
+
 void extend_environment(lisp_object sym,lisp_object value)
 {
-    lisp_object slot = cons(sym,value);
-    lisp_object binding = assoc(sym,car(env.id)); //Be careful with GC!!!
+    push(sym);
+    push(value);
+    escape_frame(); //Bindings added later would point into the region
+    if(eq(env,global_environment))
+        note_global_definition(sym);
+    reserve_cells(2);
+    pop(value);
+    pop(sym);
+    lisp_object binding = assoc(sym,car(env.id));
     if (!null(binding)) {
             set_cdr(binding.id,value);
     } else {
-        lisp_object bindings = cons(slot,car(env.id));
+        lisp_object bindings = reserved_cons(reserved_cons(sym,value),car(env.id));
         set_car(env.id,bindings);
     }
 }
 
-void extend_environment_list(unsigned argc)
+//Rest parameters
+/*
+    (lambda (a b . rest) ...) or (lambda rest ...) binds rest to a list of the remaining args.
+    The list is made in the heap even for a region frame, since the procedure may return it.
+    When the body never refers to rest, the optimizer renames it %rest and no list is made.
+*/
+
+bool rest_parameterp(lisp_object params) //True if a rest list is to be made
 {
-    env = cons(nil,env);
-    while (argc) {
-        if(null(unev)) {
-            throw SimpleError("Too many args given for application");
-        }
-        lisp_object binding = cons(car(unev.id),stack_get(--argc));
+    while(typep(params,cons_cell))
+        params = cdr(params.id);
+    return typep(params,symbol) && !eq(params,sym_unused_rest);
+}
+
+unsigned binding_cells(unsigned argc) //Taken by bind_arguments, besides a rest list
+{
+    return 2*argc + 3;
+}
+
+void bind_arguments(unsigned argc,lisp_object (*make_cell)(lisp_object,lisp_object)) //binding_cells(argc) cells are available, argc heap cells too for a rest list
+{
+    env = make_cell(nil,env);
+    while(typep(unev,cons_cell)) {
+        if(!argc)
+            throw SimpleError("Too few args given for application");
+        lisp_object binding = make_cell(car(unev.id),stack_get(--argc));
         //printf("EXTEND ENV: Tag: %lu ID %lu",car(unev.id).tag,car(unev.id).id);
-        set_car(env.id,cons(binding,car(env.id)));
+        set_car(env.id,make_cell(binding,car(env.id)));
         unev = cdr(unev.id);
     }
-    if(!null(unev))
-        throw SimpleError("Too few args given for application");
+    if(eq(unev,sym_unused_rest))
+        return;
+    if(typep(unev,symbol)) {
+        lisp_object rest = nil;
+        for(unsigned i = 0;i < argc;++i)
+            rest = reserved_cons(stack_get(i),rest);
+        set_car(env.id,make_cell(make_cell(unev,rest),car(env.id)));
+    } else if(argc) {
+        throw SimpleError("Too many args given for application");
+    }
+}
+
+void extend_environment_list(unsigned argc) //Arguments on the stack, parameters in unev
+{
+    reserve_cells(binding_cells(argc) + (rest_parameterp(unev) ? argc : 0));
+    bind_arguments(argc,reserved_cons);
 }
 
 lisp_object find_binding(lisp_object sym)
@@ -769,10 +1948,20 @@ lisp_object find_binding(lisp_object sym)
     return nil;
 }
 
+lisp_object find_local_binding(lisp_object sym) //Stops before the global environment
+{
+    for(lisp_object current_env = env;!null(current_env) && !eq(current_env,global_environment);current_env = cdr(current_env.id)) {
+        lisp_object pair = assoc(sym,car(current_env.id));
+        if(!null(pair))
+            return pair;
+    }
+    return nil;
+}
+
 void find_var(lisp_object sym)
 {
     lisp_object binding = find_binding(sym);
-    if (null(binding)) {
+    if (null(binding) || eq(cdr(binding.id),sym_unassigned)) {
         //printf("Value is null!\n");
         //val = nil;
         throw SimpleError("unbound variable");
@@ -829,11 +2018,51 @@ lisp_object if_else(lisp_object expr)
 
 void eval_lambda(void)
 {
+    escape_frame();
     lisp_object tail = cons(cdr(expr.id),env);
     lisp_object lst = cons(car(expr.id),tail);
     val = make_obj(compound,lst.id);
 }
 
+//Flat closures
+/*
+    The optimizer turns a lambda into (%closure free params . body), free being its
+    variables bound by enclosing lambdas. The closure environment is one frame holding
+    just their bindings, followed by the global environment.
+    Bindings are shared, not copied, so a binding cell is the box of a captured variable
+    and set! is seen by every closure. A variable defined later in the current frame
+    is bound to %unassigned first, its define then fills that binding.
+*/
+
+void eval_closure(void) //expr is the form
+{
+    const unsigned count = length(car(cdr(expr.id).id));
+    if(frame_regionp(env)) { //Free variables of the current frame make it escape
+        for(lisp_object free = car(cdr(expr.id).id);!null(free);free = cdr(free.id)) {
+            const lisp_object binding = find_local_binding(car(free.id));
+            if(null(binding) || frame_regionp(binding)) {
+                escape_frame();
+                break;
+            }
+        }
+    }
+    reserve_cells(3*count + 3);
+    lisp_object frame = nil;
+    for(lisp_object free = car(cdr(expr.id).id);!null(free);free = cdr(free.id)) {
+        if(eq(env,global_environment))
+            break;
+        lisp_object binding = find_local_binding(car(free.id));
+        if(null(binding)) {
+            binding = reserved_cons(car(free.id),sym_unassigned);
+            set_car(env.id,reserved_cons(binding,car(env.id)));
+        }
+        frame = reserved_cons(binding,frame);
+    }
+    const lisp_object closure_env = null(frame) ? global_environment : reserved_cons(frame,global_environment);
+    const lisp_object code = cdr(cdr(expr.id).id); //(params . body)
+    val = make_obj(compound,reserved_cons(car(code.id),reserved_cons(cdr(code.id),closure_env)).id);
+}
+
 bool truep(lisp_object expr)
 {
     return !eq(expr,val_false);
@@ -850,6 +2079,8 @@ void eval_if(void)
     if (truep(val)) {
         expr = if_then(expr);
         eval(); //Should be goto
+    } else if (null(cdr(cdr(cdr(expr.id).id).id))) {
+        val = nil; //No alternative
     } else {
         expr = if_else(expr);
         eval(); //Should be goto
@@ -864,7 +2095,17 @@ void eval_set(void)
     eval();
     pop(env);
     pop(expr);
-    lisp_object binding = find_binding(car(cdr(expr.id).id));
+    lisp_object binding = find_local_binding(car(cdr(expr.id).id));
+    const bool global = null(binding); //The walk ends at the global frame, no second lookup
+    if(global)
+        binding = assoc(car(cdr(expr.id).id),car(global_environment.id));
+    if(global && !null(binding)) {
+        push(val);
+        push(binding);
+        note_global_definition(car(binding.id));
+        pop(binding);
+        pop(val);
+    }
     if(!null(binding))
         set_cdr(binding.id,val);
 }
@@ -918,6 +2159,54 @@ void eval_quote(void)
     val = deref_cons(expr).cdr;
 }
 
+//Promises
+/*
+    Promise cell: (expression . environment) until forced, (value . nil) after.
+*/
+
+void eval_delay(void) //(delay expression)
+{
+    escape_frame();
+    val = make_obj(promise,cons(car(cdr(expr.id).id),env).id);
+}
+
+void eval_cons_stream(void) //(cons-stream head tail), the tail is delayed
+{
+    push(expr);
+    push(env);
+    expr = car(cdr(expr.id).id);
+    eval();
+    pop(env);
+    pop(expr);
+    push(val);
+    escape_frame();
+    val = make_obj(promise,cons(car(cdr(cdr(expr.id).id).id),env).id);
+    val = cons(stack_pop(),val);
+}
+
+void force_promise(void) //Forces the promise in val, other objects are left as they are
+{
+    if(!typep(val,promise))
+        return;
+    if(null(cdr(val.id))) {
+        val = car(val.id);
+        return;
+    }
+    push(val);
+    push(env);
+    expr = car(val.id);
+    env = cdr(val.id);
+    eval();
+    pop(env);
+    const lisp_object forced = stack_pop();
+    if(null(cdr(forced.id))) { //Forced again while it was evaluated, the first value wins
+        val = car(forced.id);
+        return;
+    }
+    set_car(forced.id,val);
+    set_cdr(forced.id,nil); //Environment can be collected now
+}
+
 bool consp(lisp_object expr)
 {
     return typep(expr,cons_cell);
@@ -958,9 +2247,9 @@ bool blockp(lisp_object expr)
     return eq(car(expr.id),sym_begin);
 }
 
-bool letp(lisp_object expr)
+bool define_syntaxp(lisp_object expr)
 {
-    return eq(car(expr.id),sym_let);
+    return eq(car(expr.id),sym_define_syntax);
 }
 
 void eval_apply();
@@ -970,6 +2259,7 @@ void apply_primitive(unsigned);
 
 void eval(void) //Mutates val register
 {
+    safepoint_poll(); //Green threads switch and limits stop evaluation between steps
     if(consp(expr)) {
             if(lambdap(expr)) {
                 expr = cdr(expr.id);
@@ -985,13 +2275,17 @@ void eval(void) //Mutates val register
             } else if(blockp(expr)){
                 expr = cdr(expr.id);
                 eval_block();
-             /*{else if (letp(expr)) {
-                push(unev);
-                push(expr);
-                proc = find_var(make_symbol(expand-let));
-                apply_compound(1);
-                expr = val;
-                */
+            } else if(define_syntaxp(expr)) {
+                eval_define_syntax();
+            } else if(eq(car(expr.id),sym_closure)) {
+                eval_closure();
+            } else if(eq(car(expr.id),sym_delay)) {
+                eval_delay();
+            } else if(eq(car(expr.id),sym_cons_stream)) {
+                eval_cons_stream();
+            } else if(derivedp(expr)) {
+                expand_derived(); //Replaces the form, so it is expanded once
+                eval();
             } else {eval_apply(); }
     } else if (variablep(expr)) {
         find_var(expr);
@@ -1000,17 +2294,28 @@ void eval(void) //Mutates val register
     }
 }
 
-lisp_object val, expr, argl, proc, unev, env;
-lisp_object global_environment;
+thread_local lisp_object val, expr, argl, proc, unev, env;
+thread_local lisp_object global_environment;
 
 void eval_apply(void)
 {
-    printf("Apply: Stack size is %u\n",stack_pointer);
     push(unev); //REMEMBER ABOUT IT
     unev = get_args(expr);
     unsigned argc = 0;
-    expr = get_procedure(expr);
-    eval();
+    if(variablep(get_procedure(expr))) {
+        find_var(get_procedure(expr));
+        if(typep(val,macro)) {
+            pop(unev);
+            expand_macro_use(); //Replaces the form, so it is expanded once
+            eval();
+            return;
+        }
+    } else {
+        expr = get_procedure(expr);
+        push(env);
+        eval();
+        pop(env);
+    }
     proc = val;
     while (!null(unev)) {
         expr = deref_cons(unev).car;
@@ -1024,29 +2329,48 @@ void eval_apply(void)
         unev = deref_cons(unev).cdr;
     }
 
-    if (!(typep(proc,compound) || typep(proc,primitive)))
-        throw SimpleError("Cannot find procedure for application");
+    apply_procedure(argc);
+    //pop(unev) - Must be NOT here for tail call optimization!!!
+}
+
+void apply_procedure(unsigned argc) //Arguments are pushed after unev, both are popped
+{
     if (typep(proc,compound)){
         apply_compound(argc);
     } else if (typep(proc,primitive)){
         apply_primitive(argc);
-    }
-    //pop(unev) - Must be NOT here for tail call optimization!!!
+    } else if (typep(proc,continuation)){
+        apply_continuation(argc);
+    } else throw SimpleError("Cannot find procedure for application");
 }
 
 void apply_compound(unsigned argc)
 {
+    if(jit_apply(argc))
+        return;
     env = proc_env(deref_cons(proc));
     unev = proc_params(deref_cons(proc));
-    extend_environment_list(argc);
+    expr = proc_body(deref_cons(proc));
+    const bool stack_frame = typep(expr,cons_cell) && eq(car(expr.id),sym_stack_frame);
+    frame_mark mark(stack_frame && frame_room(binding_cells(argc)));
+    if(mark.used) {
+        if(rest_parameterp(unev))
+            reserve_cells(argc);
+        bind_arguments(argc,frame_cons);
+    } else {
+        extend_environment_list(argc);
+    }
     stack_drop(argc);
     pop(unev); //It was pushed in eval_apply
     expr = proc_body(deref_cons(proc));
+    if(stack_frame)
+        expr = cdr(expr.id);
     eval_block(); //Must be goto instead!
 }
 
 void apply_primitive(unsigned argc)
 {
+    check_arity(proc,argc);
     primitive_adress(proc)(argc);
     stack_drop(argc);
     pop(unev);
@@ -1064,9 +2388,8 @@ void init_global_env(void)
 {
     global_environment = cons(nil,nil);
     add_var("nil",nil);
-    for(size_t i = 0;i != (sizeof(primitive_procedures)/sizeof(built_in));++i) {
-        lisp_object temp = cons(primitive_procedures[i].symbol,make_obj(primitive,i));
-        printf("Adding symbol to global env: %u \n",primitive_procedures[i].symbol.id);
+    for(size_t i = 0;i != primitives_count();++i) {
+        lisp_object temp = cons(primitive_entry(i).symbol,make_obj(primitive,i));
         lisp_object bindings = cons(temp,car(global_environment.id));
         set_car(global_environment.id,bindings);
     }
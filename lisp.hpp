@@ -2,19 +2,31 @@
 #define LISP_HPP_INCLUDED
 
 #include <vector>
+#include <string>
+#include <cstdio>
+#include <functional>
+#include <chrono>
 #include "lisp_types.hpp"
 #include "memory.hpp"
 
-lisp_object make_lisp_object(lisp_type type,unsigned id);
+lisp_object make_lisp_object(lisp_type type,object_word id);
 
 #define make_obj(type,val) make_lisp_object(lisp_type:: type, val)
 
 lisp_object number(unsigned);
 
+#ifdef LISP_NAN_BOXING
+lisp_object number(int);
+lisp_object number(object_word);
+
+lisp_object make_double_float(double value);
+double double_float_value(lisp_object obj);
+#endif
+
 //Registers
 
-extern lisp_object val, expr, argl, proc, unev, env;
-extern lisp_object global_environment;
+extern thread_local lisp_object val, expr, argl, proc, unev, env;
+extern thread_local lisp_object global_environment;
 
 //Obarray
 using symbol = const char*;
@@ -27,6 +39,10 @@ const char* get_symbol(unsigned id);
 
 lisp_object make_symbol(const char* name);
 
+lisp_object intern(const char* name);
+
+lisp_object gensym(const char* prefix);
+
 //Constants
 
 extern const long unsigned max_num;
@@ -40,11 +56,42 @@ extern const lisp_object sym_set;
 extern const lisp_object sym_if;
 extern const lisp_object sym_define;
 extern const lisp_object sym_begin;
-
-extern const unsigned fixnum_negative_flag;
+extern const lisp_object sym_let;
+extern const lisp_object sym_let_star;
+extern const lisp_object sym_letrec;
+extern const lisp_object sym_letrec_star;
+extern const lisp_object sym_cond;
+extern const lisp_object sym_case;
+extern const lisp_object sym_and;
+extern const lisp_object sym_or;
+extern const lisp_object sym_when;
+extern const lisp_object sym_unless;
+extern const lisp_object sym_else;
+extern const lisp_object sym_arrow;
+extern const lisp_object sym_define_syntax;
+extern const lisp_object sym_syntax_rules;
+extern const lisp_object sym_ellipsis;
+extern const lisp_object sym_underscore;
+extern const lisp_object sym_delay;
+extern const lisp_object sym_cons_stream;
+extern const lisp_object sym_define_record_type;
+extern const lisp_object sym_closure;
+extern const lisp_object sym_unassigned;
+extern const lisp_object sym_stack_frame;
+extern const lisp_object sym_unused_rest;
+
+extern const object_word fixnum_negative_flag;
+
+long long fixnum_value(lisp_object obj);
 
 //Stack
 
+const unsigned stack_size = 1000; //Of a segment
+const unsigned stack_segments = 64; //Each green thread has its own segment
+
+extern thread_local lisp_object stack[stack_size*stack_segments];
+extern thread_local unsigned stack_pointer, stack_base, stack_limit; //Current segment
+
 lisp_object stack_get(unsigned offset);
 
 void stack_push(lisp_object val);
@@ -111,26 +158,202 @@ void prim_mul(unsigned num);
 
 void prim_div(unsigned num);
 
+void prim_less(unsigned num);
+
+void prim_greater(unsigned num);
+
+void prim_less_equal(unsigned num);
+
+void prim_greater_equal(unsigned num);
+
+void prim_number_equal(unsigned num);
+
 void prim_car(unsigned num);
 
 void prim_cdr(unsigned num);
 
 void prim_null(unsigned num);
 
+void prim_force(unsigned num);
+
+void prim_stream_car(unsigned num);
+
+void prim_stream_cdr(unsigned num);
+
+//Records
+
+void prim_make_record(unsigned num);
+
+void prim_recordp(unsigned num);
+
+void prim_record_ref(unsigned num);
+
+void prim_record_set(unsigned num);
+
 void prim_list(unsigned num);
 
+void prim_apply(unsigned num);
+
 void prim_set_car(unsigned num);
 
 void prim_set_cdr(unsigned num);
 
+void prim_save_image(unsigned num);
+
+void prim_load(unsigned num);
+
+//Isolates
+
+void prim_parallel_map(unsigned num);
+
+void prim_future(unsigned num);
+
+void prim_touch(unsigned num);
+
+//JIT
+
+void prim_jit_threshold(unsigned num);
+
+//Green threads
+
+void prim_spawn(unsigned num);
+
+void prim_yield(unsigned num);
+
+void prim_join(unsigned num);
+
+void prim_make_channel(unsigned num);
+
+void prim_channel_send(unsigned num);
+
+void prim_channel_receive(unsigned num);
+
+void prim_thread_quantum(unsigned num);
+
+//Ports
+
+void prim_open_input_file(unsigned num);
+
+void prim_open_output_file(unsigned num);
+
+void prim_unix_listen(unsigned num);
+
+void prim_unix_connect(unsigned num);
+
+void prim_tcp_listen(unsigned num);
+
+void prim_tcp_connect(unsigned num);
+
+void prim_accept(unsigned num);
+
+void prim_read_string(unsigned num);
+
+void prim_read_line(unsigned num);
+
+void prim_write_string(unsigned num);
+
+void prim_close_port(unsigned num);
+
+void prim_open_output_string(unsigned num);
+
+void prim_get_output_string(unsigned num);
+
+//Extensions
+
+void prim_load_extension(unsigned num);
+
+void prim_make_byte_string(unsigned num);
+
+void prim_string_byte_ref(unsigned num);
+
+void prim_string_byte_set(unsigned num);
+
+//Lists
+
+unsigned list_length(lisp_object lst,const char* msg);
+
+void call_back(unsigned at,unsigned argc);
+
+void prim_append(unsigned num);
+
+void prim_reverse(unsigned num);
+
+void prim_map(unsigned num);
+
+void prim_for_each(unsigned num);
+
+void prim_filter(unsigned num);
+
+void prim_fold_left(unsigned num);
+
+void prim_fold_right(unsigned num);
+
+void prim_assq(unsigned num);
+
+void prim_assoc(unsigned num);
+
+void prim_memq(unsigned num);
+
+void prim_member(unsigned num);
+
+void prim_list_tail(unsigned num);
+
+void prim_list_ref(unsigned num);
+
+//Strings
+
+void prim_string_append(unsigned num);
+
+void prim_substring(unsigned num);
+
+void prim_string_to_symbol(unsigned num);
+
+void prim_symbol_to_string(unsigned num);
+
+void prim_number_to_string(unsigned num);
+
+//Equality
+
+bool equal_objects(lisp_object o1,lisp_object o2,bool structural);
+
+uint64_t equal_hash(lisp_object obj);
+
+void prim_equal(unsigned num);
+
+void prim_eqv(unsigned num);
+
+void prim_equal_hash(unsigned num);
+
+//Continuations
+
+void apply_continuation(unsigned argc);
+
+void prim_call_cc(unsigned num);
+
+void prim_dynamic_wind(unsigned num);
+
+//Sorting
+
+void prim_sort(unsigned num);
+
+void prim_sort_in_place(unsigned num);
+
 struct built_in
 {
     lisp_object symbol;
     primitive_procedure adress;
+    int min_args = 0; //Checked for native primitives only
+    int max_args = -1; //-1 for any count
 };
 
 primitive_procedure primitive_adress(lisp_object proc);
 
+lisp_object find_primitive(const char* name);
+
+int primitive_index(lisp_object sym);
+
+void define_primitive(const char* name,primitive_procedure adress,int min_args,int max_args);
+
 //Environment
 
 lisp_object assoc(const lisp_object sym,const lisp_object alist);
@@ -139,16 +362,132 @@ void extend_environment(lisp_object sym,lisp_object value);
 
 void find_var(lisp_object sym);
 
+//Reader
+
+extern FILE* read_port;
+
+bool read(void);
+void read_skip_line(void);
+
+//Syntax
+
+bool derivedp(lisp_object expr);
+
+void expand_derived(void);
+
+void eval_define_syntax(void);
+
+void expand_macro_use(void);
+
+//Optimizer
+
+extern thread_local lisp_object inline_patches, redefined_primitives;
+
+void note_global_definition(lisp_object sym);
+void gc_trace_inline_patches(void);
+
+void optimize(void);
+
+//JIT
+
+bool jit_apply(unsigned argc);
+
+void jit_collect(void);
+
+void jit_invalidate(void);
+
+//Green threads
+
+extern thread_local int quantum_left; //Eval steps and allocations before the next switch
+extern thread_local unsigned live_threads;
+
+void preempt(void);
+
+void gc_trace_threads(void);
+
+unsigned running_thread(void);
+
+void wake_thread(unsigned id);
+
+void wait_until(const std::function<bool()>& ready,const char* deadlock);
+
+void stop_threads(void);
+
+//Safepoints
+
+struct evaluation_limits //0 for none
+{
+    unsigned long long time_ms = 0;
+    unsigned long long steps = 0;
+    unsigned long long cells = 0; //Allocated in the heap
+};
+
+class evaluation_scope //A top-level evaluation, limits count from the outermost scope
+{
+public:
+    explicit evaluation_scope(const evaluation_limits& limits);
+    ~evaluation_scope();
+};
+
+extern thread_local unsigned long long eval_steps;
+
+inline void safepoint_poll(void) //Procedure entries and tail calls
+{
+    ++eval_steps;
+    if(--quantum_left < 0)
+        preempt();
+}
+
+void check_limits(void);
+
+int limits_timeout(void);
+
+void request_interrupt(void);
+
+void catch_interrupts(bool enable);
+
+//Ports
+
+bool poll_descriptors(int timeout);
+
+void gc_sweep_ports(void);
+
 //Evaluator
 
 bool variablep(lisp_object);
 
+bool truep(lisp_object expr);
+
+void force_promise(void);
+
 void eval(void);
 
-void print(void);
+void apply_procedure(unsigned argc);
+
+void print_obj(lisp_object obj);
+
+void print(void); //val and a newline
 
 //Env
 
 void init_global_env(void);
 
+//Image
+
+void save_image(const char* path);
+
+void load_image(const char* path);
+
+//Loading
+
+void read_source(const std::string& content);
+
+//Embedding
+
+void gc_trace_handles(void);
+
+unsigned long long allocated_cells(void);
+
+void print_statistics(FILE* out,std::chrono::steady_clock::duration wall_time);
+
 #endif // LISP_HPP_INCLUDED
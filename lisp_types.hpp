@@ -2,9 +2,42 @@
 #define LISP_TYPES_HPP_INCLUDED
 
 #include <exception>
+#include <cstdint>
 
 //Object
-enum class lisp_type {nil = 0, broken_heart, cons_cell, lisp_string, character, lisp_vector, fixnum, double_float, bignum, real, boolean, vector, primitive, compound, continuation, symbol};
+enum class lisp_type {nil = 0, broken_heart, cons_cell, lisp_string, character, lisp_vector, fixnum, double_float, bignum, real, boolean, vector, primitive, compound, continuation, symbol, future, macro, promise, record, large, thread, channel, port};
+
+#ifdef LISP_NAN_BOXING
+/*
+    64-bit objects, selected at build time with -DLISP_NAN_BOXING.
+    A double is stored as its complemented bits, any other object as a 5-bit tag and a 46-bit id
+    (fixnum value, heap index, ...) with the top 13 bits clear.
+    Those are the complements of negative quiet NaNs, NaN doubles are stored as the positive one.
+    So zeroed memory still reads as nil.
+*/
+
+using object_word = uint64_t;
+
+const unsigned object_id_bits = 46;
+static_assert(static_cast<unsigned>(lisp_type::port) < 32,"Tags must fit in 5 bits");
+
+struct lisp_object
+{
+    object_word id : object_id_bits;
+    object_word tag_bits : 5;
+    object_word box : 13; //0 unless a double
+};
+
+inline lisp_type object_type(lisp_object obj)
+{
+    return obj.box == 0 ? static_cast<lisp_type>(obj.tag_bits) : lisp_type::double_float;
+}
+#else
+//32-bit objects: tag in the low byte, 24-bit id
+
+using object_word = unsigned;
+
+const unsigned object_id_bits = 24;
 
 struct lisp_object
 {
@@ -12,13 +45,19 @@ struct lisp_object
     unsigned id : 24;
 };
 
+inline lisp_type object_type(lisp_object obj)
+{
+    return obj.tag;
+}
+#endif
+
 struct cons_cell
 {
     lisp_object car;
     lisp_object cdr;
 };
 
-#define typep(obj,type) (obj .tag == lisp_type:: type)
+#define typep(obj,type) (object_type(obj) == lisp_type:: type)
 #define etypep(obj,type,msg) if (!typep(obj,type)) throw SimpleError(msg);
 #define numberp(obj) typep(obj,fixnum)
 
@@ -46,5 +85,11 @@ private:
     const char* msg;
 };
 
+class interruption : public SimpleError //A limit reached at a safepoint, see safepoint.cpp
+{
+public:
+    using SimpleError::SimpleError;
+};
+
 
 #endif // LISP_TYPES_HPP_INCLUDED
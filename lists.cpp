@@ -0,0 +1,292 @@
+//List library
+#include "lisp.hpp"
+
+/*
+    Procedures taking a procedure call it back through apply_procedure, with its args pushed
+    straight from the lists: no argument list is built.
+    A callback may collect or switch threads, so lists are walked by cursors kept on the stack
+    and read again after each call. Stack slots are addressed from the frame start.
+*/
+
+unsigned list_length(lisp_object lst,const char* msg) //Proper lists only
+{
+    unsigned length = 0;
+    for(;!null(lst);lst = cdr(lst.id),++length)
+        if(!typep(lst,cons_cell))
+            throw SimpleError(msg);
+    return length;
+}
+
+lisp_object reverse_in_place(lisp_object lst) //Cells just built by the caller
+{
+    lisp_object res = nil;
+    while(!null(lst)) {
+        const lisp_object next = cdr(lst.id);
+        set_cdr(lst.id,res);
+        res = lst;
+        lst = next;
+    }
+    return res;
+}
+
+lisp_object reversed_copy(unsigned at,const char* msg) //Of the list at stack[at]
+{
+    reserve_cells(list_length(stack[at],msg));
+    lisp_object res = nil;
+    for(lisp_object lst = stack[at];!null(lst);lst = cdr(lst.id))
+        res = reserved_cons(car(lst.id),res);
+    return res;
+}
+
+//Cursors: count lists in consecutive stack slots
+
+bool cursors_live(unsigned cursors,unsigned count,const char* msg) //False once a list ends
+{
+    for(unsigned i = 0;i < count;++i) {
+        const lisp_object cursor = stack[cursors + i];
+        if(null(cursor))
+            return false;
+        if(!typep(cursor,cons_cell))
+            throw SimpleError(msg);
+    }
+    return true;
+}
+
+void push_cars(unsigned cursors,unsigned count)
+{
+    for(unsigned i = 0;i < count;++i)
+        push(car(stack[cursors + i].id));
+}
+
+void advance_cursors(unsigned cursors,unsigned count)
+{
+    for(unsigned i = 0;i < count;++i)
+        stack[cursors + i] = cdr(stack[cursors + i].id);
+}
+
+void call_back(unsigned at,unsigned argc) //The procedure at stack[at], argc args pushed after unev
+{
+    proc = stack[at];
+    apply_procedure(argc);
+}
+
+//Primitives
+
+void prim_append(unsigned num) //The last list is shared
+{
+    if(num == 0) {
+        val = nil;
+        return;
+    }
+    unsigned total = 0;
+    for(unsigned i = num - 1;i > 0;--i)
+        total += list_length(stack_get(i),"append: args must be proper lists");
+    reserve_cells(total);
+    lisp_object head = nil, tail = nil;
+    for(unsigned i = num - 1;i > 0;--i) {
+        for(lisp_object lst = stack_get(i);!null(lst);lst = cdr(lst.id)) {
+            const lisp_object cell = reserved_cons(car(lst.id),nil);
+            if(null(head))
+                head = cell;
+            else
+                set_cdr(tail.id,cell);
+            tail = cell;
+        }
+    }
+    if(null(head)) {
+        val = stack_get(0);
+    } else {
+        set_cdr(tail.id,stack_get(0));
+        val = head;
+    }
+}
+
+void prim_reverse(unsigned num)
+{
+    if(num != 1)
+        throw SimpleError("reverse: list awaited");
+    val = reversed_copy(stack_pointer - 1,"reverse: arg must be proper list");
+}
+
+void prim_map(unsigned num) //(map procedure list ...), as long as the shortest list
+{
+    if(num < 2)
+        throw SimpleError("map: procedure and lists awaited");
+    const unsigned lists = num - 1;
+    const unsigned at = stack_pointer - num;
+    const unsigned cursors = stack_pointer;
+    for(unsigned i = 0;i < lists;++i)
+        push(stack[at + 1 + i]);
+    push(nil); //Results, last first
+    while(cursors_live(cursors,lists,"map: args must be proper lists")) {
+        push(unev);
+        push_cars(cursors,lists);
+        call_back(at,lists);
+        stack[cursors + lists] = cons(val,stack[cursors + lists]);
+        advance_cursors(cursors,lists);
+    }
+    val = reverse_in_place(stack[cursors + lists]);
+    stack_set(cursors);
+}
+
+void prim_for_each(unsigned num)
+{
+    if(num < 2)
+        throw SimpleError("for-each: procedure and lists awaited");
+    const unsigned lists = num - 1;
+    const unsigned at = stack_pointer - num;
+    const unsigned cursors = stack_pointer;
+    for(unsigned i = 0;i < lists;++i)
+        push(stack[at + 1 + i]);
+    while(cursors_live(cursors,lists,"for-each: args must be proper lists")) {
+        push(unev);
+        push_cars(cursors,lists);
+        call_back(at,lists);
+        advance_cursors(cursors,lists);
+    }
+    stack_set(cursors);
+    val = val_true;
+}
+
+void prim_filter(unsigned num) //(filter predicate list)
+{
+    if(num != 2)
+        throw SimpleError("filter: predicate and list awaited");
+    const unsigned at = stack_pointer - 2;
+    const unsigned cursor = stack_pointer;
+    push(stack[at + 1]);
+    push(nil); //Kept elements, last first
+    while(cursors_live(cursor,1,"filter: arg must be proper list")) {
+        push(unev);
+        push_cars(cursor,1);
+        call_back(at,1);
+        if(truep(val))
+            stack[cursor + 1] = cons(car(stack[cursor].id),stack[cursor + 1]);
+        advance_cursors(cursor,1);
+    }
+    val = reverse_in_place(stack[cursor + 1]);
+    stack_set(cursor);
+}
+
+void fold(unsigned num,bool right) //Stack: procedure, initial value, lists
+{
+    const unsigned lists = num - 2;
+    const unsigned at = stack_pointer - num;
+    const unsigned cursors = stack_pointer;
+    const char* const msg = right ? "fold-right: args must be proper lists of the same length" :
+                                    "fold-left: args must be proper lists";
+    for(unsigned i = 0;i < lists;++i) {
+        if(right) {
+            if(list_length(stack[at + 2 + i],msg) != list_length(stack[at + 2],msg))
+                throw SimpleError(msg);
+            push(reversed_copy(at + 2 + i,msg));
+        } else {
+            push(stack[at + 2 + i]);
+        }
+    }
+    push(stack[at + 1]); //Accumulator
+    while(cursors_live(cursors,lists,msg)) {
+        push(unev);
+        if(!right)
+            push(stack[cursors + lists]);
+        push_cars(cursors,lists);
+        if(right)
+            push(stack[cursors + lists]);
+        call_back(at,lists + 1);
+        stack[cursors + lists] = val;
+        advance_cursors(cursors,lists);
+    }
+    val = stack[cursors + lists];
+    stack_set(cursors);
+}
+
+void prim_fold_left(unsigned num) //(fold-left f init list ...) calls (f acc x ...) from the left
+{
+    if(num < 3)
+        throw SimpleError("fold-left: procedure, initial value and lists awaited");
+    fold(num,false);
+}
+
+void prim_fold_right(unsigned num) //(fold-right f init list ...) calls (f x ... acc) from the right
+{
+    if(num < 3)
+        throw SimpleError("fold-right: procedure, initial value and lists awaited");
+    fold(num,true);
+}
+
+void find_association(unsigned num,bool equal,const char* msg)
+{
+    if(num != 2)
+        throw SimpleError(msg);
+    const lisp_object key = stack_get(1);
+    for(lisp_object lst = stack_get(0);!null(lst);lst = cdr(lst.id)) {
+        if(!typep(lst,cons_cell) || !typep(car(lst.id),cons_cell))
+            throw SimpleError(msg);
+        const lisp_object entry = car(car(lst.id).id);
+        if(equal ? equal_objects(key,entry,true) : eq(key,entry)) {
+            val = car(lst.id);
+            return;
+        }
+    }
+    val = val_false;
+}
+
+void find_member(unsigned num,bool equal,const char* msg)
+{
+    if(num != 2)
+        throw SimpleError(msg);
+    const lisp_object key = stack_get(1);
+    for(lisp_object lst = stack_get(0);!null(lst);lst = cdr(lst.id)) {
+        if(!typep(lst,cons_cell))
+            throw SimpleError(msg);
+        if(equal ? equal_objects(key,car(lst.id),true) : eq(key,car(lst.id))) {
+            val = lst;
+            return;
+        }
+    }
+    val = val_false;
+}
+
+void prim_assq(unsigned num)
+{
+    find_association(num,false,"assq: key and association list awaited");
+}
+
+void prim_assoc(unsigned num)
+{
+    find_association(num,true,"assoc: key and association list awaited");
+}
+
+void prim_memq(unsigned num)
+{
+    find_member(num,false,"memq: object and list awaited");
+}
+
+void prim_member(unsigned num)
+{
+    find_member(num,true,"member: object and list awaited");
+}
+
+lisp_object list_tail(unsigned num,const char* msg)
+{
+    if(num != 2 || !typep(stack_get(0),fixnum))
+        throw SimpleError(msg);
+    lisp_object lst = stack_get(1);
+    for(unsigned k = stack_get(0).id;k > 0;--k,lst = cdr(lst.id))
+        if(!typep(lst,cons_cell))
+            throw SimpleError(msg);
+    return lst;
+}
+
+void prim_list_tail(unsigned num) //(list-tail list k)
+{
+    val = list_tail(num,"list-tail: list and index awaited");
+}
+
+void prim_list_ref(unsigned num) //(list-ref list k)
+{
+    const lisp_object lst = list_tail(num,"list-ref: list and index awaited");
+    if(!typep(lst,cons_cell))
+        throw SimpleError("list-ref: index out of range");
+    val = car(lst.id);
+}
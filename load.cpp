@@ -0,0 +1,174 @@
+//Loading source files through a fasl cache
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include "lisp.hpp"
+
+/*
+    Fasl file: header, symbol names, message cells.
+    Forms are stored as one message, so loading is a bulk read and one bulk copy into the heap.
+    The cache lies next to the source and is valid while the content hash matches.
+*/
+
+struct fasl_header
+{
+    char magic[8];
+    uint64_t hash;
+    unsigned symbols;
+    unsigned symbols_bytes;
+    unsigned cells;
+};
+
+#ifdef LISP_NAN_BOXING
+const char fasl_magic[8] = {'L','I','S','P','F','S','W','2'}; //64-bit cells
+#else
+const char fasl_magic[8] = {'L','I','S','P','F','S','L','2'};
+#endif
+
+uint64_t content_hash(const std::string& content) //FNV-1a
+{
+    uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : content) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool read_file(const std::string& path,std::string& content)
+{
+    FILE* file = fopen(path.c_str(),"rb");
+    if(!file)
+        return false;
+    char buffer[4096];
+    size_t count = 0;
+    while((count = fread(buffer,1,sizeof(buffer),file)) > 0)
+        content.append(buffer,count);
+    fclose(file);
+    return true;
+}
+
+bool read_fasl(const std::string& path,uint64_t hash) //Sets val to the list of forms
+{
+    FILE* file = fopen(path.c_str(),"rb");
+    if(!file)
+        return false;
+    fasl_header header;
+    std::string names;
+    message msg;
+    bool valid = fread(&header,sizeof(header),1,file) == 1 &&
+                 std::equal(fasl_magic,fasl_magic + 8,header.magic) && header.hash == hash;
+    if(valid) {
+        names.resize(header.symbols_bytes);
+        msg.resize(header.cells);
+        valid = fread(&names[0],1,names.size(),file) == names.size() &&
+                fread(msg.data(),sizeof(memory_cell),msg.size(),file) == msg.size() && !msg.empty();
+    }
+    fclose(file);
+    if(!valid)
+        return false;
+
+    std::vector<unsigned> symbols;
+    for(size_t offset = 0;offset < names.size() && symbols.size() < header.symbols;offset += strlen(&names[offset]) + 1) {
+        int id = symbol_id(&names[offset]);
+        if(id == -1) {
+            char* new_location = new char[strlen(&names[offset]) + 1];
+            strcpy(new_location,&names[offset]);
+            id = make_symbol(new_location).id;
+        }
+        symbols.push_back(id);
+    }
+    if(symbols.size() != header.symbols)
+        return false;
+    val = receive_message(msg,&symbols);
+    return true;
+}
+
+void write_fasl(const std::string& path,uint64_t hash,lisp_object forms)
+{
+    std::vector<unsigned> symbols;
+    message msg;
+    message_begin(msg,false,&symbols);
+    message_end(message_copy(forms));
+
+    fasl_header header = {};
+    std::copy(fasl_magic,fasl_magic + 8,header.magic);
+    header.hash = hash;
+    header.symbols = symbols.size();
+    for(unsigned id : symbols)
+        header.symbols_bytes += strlen(get_symbol(id)) + 1;
+    header.cells = msg.size();
+
+    FILE* file = fopen(path.c_str(),"wb");
+    if(!file)
+        return; //The cache is optional
+    bool written = fwrite(&header,sizeof(header),1,file) == 1;
+    for(unsigned id : symbols)
+        written = written && fwrite(get_symbol(id),strlen(get_symbol(id)) + 1,1,file) == 1;
+    written = written && fwrite(msg.data(),sizeof(memory_cell),msg.size(),file) == msg.size();
+    if(fclose(file) != 0 || !written)
+        remove(path.c_str());
+}
+
+void read_source(const std::string& content) //Sets val to the list of forms
+{
+    FILE* port = fmemopen(const_cast<char*>(content.data()),content.size(),"r");
+    if(!port)
+        throw SimpleError("load: cannot read source");
+    FILE* saved_port = read_port;
+    read_port = port;
+    push(nil);
+    try {
+        while(read())
+            push(cons(expr,stack_pop()));
+    } catch(SimpleError&) {
+        read_port = saved_port;
+        fclose(port);
+        stack_drop(1);
+        throw;
+    }
+    read_port = saved_port;
+    fclose(port);
+
+    lisp_object forms = stack_pop();
+    val = nil;
+    while(!null(forms)) { //Reverse in place
+        lisp_object next = cdr(forms.id);
+        set_cdr(forms.id,val);
+        val = forms;
+        forms = next;
+    }
+}
+
+void prim_load(unsigned num)
+{
+    if(num != 1 || !typep(stack_get(0),lisp_string))
+        throw SimpleError("load: file name awaited");
+    const std::string path(reinterpret_cast<char*>(deref_string(stack_get(0))),vector_length(stack_get(0)));
+    std::string content;
+    if(!read_file(path,content))
+        throw SimpleError("load: cannot open file");
+
+    const uint64_t hash = content_hash(content);
+    const std::string fasl_path = path + ".fasl";
+    if(!read_fasl(fasl_path,hash)) {
+        read_source(content);
+        write_fasl(fasl_path,hash,val);
+    }
+
+    push(val);
+    push(env);
+    while(!null(stack_get(1))) {
+        expr = car(stack_get(1).id);
+        env = global_environment;
+        optimize();
+        eval();
+        lisp_object saved_env = stack_pop();
+        lisp_object forms = stack_pop();
+        push(cdr(forms.id));
+        push(saved_env);
+    }
+    pop(env);
+    stack_drop(1);
+}
@@ -1,19 +1,47 @@
 #ifndef MEMORY_HPP_INCLUDED
 #define MEMORY_HPP_INCLUDED
+#include <vector>
 #include "lisp_types.hpp"
 
 //Memory space
 using memory_adress = unsigned int;
 using memory_adress = unsigned int;
 
+extern thread_local memory_cell* working_memory;
+
 unsigned allocate_pair(void);
 unsigned allocate_byte_vector(unsigned);
+unsigned allocate_vector(unsigned);
+
+bool reserve_cells(unsigned count);
+lisp_object reserved_cons(lisp_object car,lisp_object cdr);
+unsigned string_cells(unsigned length);
+unsigned vector_cells(unsigned length);
 
 cons_cell deref_cons(lisp_object);
 byte_t* deref_string(lisp_object);
+byte_t* writable_string(lisp_object); //Before writing to the bytes
+lisp_object* deref_vector(lisp_object);
 
 lisp_object make_string(const unsigned,const char* const);
+lisp_object make_substring(lisp_object str,unsigned start,unsigned length);
 
 unsigned vector_length(lisp_object);
 
+lisp_object gc_trace(lisp_object obj);
+bool broken_heartp(memory_adress cell); //Already moved by the running collection
+
+void init_isolate_memory(void);
+
+//Messages between isolates
+
+using message = std::vector<memory_cell>;
+
+void message_begin(message& msg,bool with_globals,std::vector<unsigned>* symbols = nullptr);
+lisp_object message_copy(lisp_object obj);
+lisp_object message_cons(lisp_object car,lisp_object cdr);
+void message_end(lisp_object root);
+
+lisp_object receive_message(const message& msg,const std::vector<unsigned>* symbols = nullptr);
+
 #endif // MEMORY_HPP_INCLUDED
@@ -0,0 +1,417 @@
+#include <vector>
+#include <algorithm>
+#include "lisp.hpp"
+
+//Optimizing pass
+/*
+    Runs once over every top-level form before it is evaluated:
+    * expands derived forms and macro uses,
+    * replaces references to primitives by the primitive objects while their global binding is not redefined,
+    * folds calls to pure primitives with constant arguments,
+    * replaces an if with a constant test by the taken branch,
+    * turns lambdas into flat closures listing their free variables (see eval_closure),
+    * marks the bodies whose frame no closure, promise or definition can keep with %stack-frame,
+    * renames %rest a rest parameter the body never refers to, so that no rest list is made.
+    Every rewritten cell is recorded in inline_patches with its original contents.
+    A global define or set! of a primitive name restores them all.
+    The cell being rewritten is kept on the stack, since recording allocates.
+    The collector drops the patches of cells nothing else reaches, see gc_trace_inline_patches.
+*/
+
+thread_local lisp_object inline_patches, redefined_primitives;
+thread_local std::vector<unsigned> optimizer_scope; //Lexically bound symbols
+
+const size_t no_rest = size_t(-1);
+
+struct closure_scope //A lambda being optimized
+{
+    size_t scope_start; //Its bindings in optimizer_scope
+    std::vector<unsigned> free;
+    bool opaque; //Local macros may expand into references the pass never saw
+    bool captures; //Its frame may outlive the call
+    size_t rest = no_rest; //Its rest parameter in optimizer_scope
+    bool rest_used = false;
+};
+
+thread_local std::vector<closure_scope> closure_scopes;
+
+bool redefinedp(lisp_object sym)
+{
+    for(lisp_object current = redefined_primitives;!null(current);current = cdr(current.id))
+        if(eq(car(current.id),sym))
+            return true;
+    return false;
+}
+
+bool scopedp(lisp_object sym)
+{
+    return std::find(optimizer_scope.begin(),optimizer_scope.end(),sym.id) != optimizer_scope.end();
+}
+
+void note_global_definition(lisp_object sym)
+{
+    if(primitive_index(sym) == -1 || redefinedp(sym))
+        return;
+    redefined_primitives = cons(sym,redefined_primitives);
+    for(lisp_object patch = inline_patches;!null(patch);patch = cdr(patch.id)) { //Latest first
+        const lisp_object cell = car(car(patch.id).id);
+        const lisp_object original = cdr(car(patch.id).id);
+        set_car(cell.id,car(original.id));
+        set_cdr(cell.id,cdr(original.id));
+    }
+    inline_patches = nil;
+    jit_invalidate(); //Code inlined the primitive too
+}
+
+void record_patch(unsigned offset) //The cell at stack offset is about to be rewritten
+{
+    lisp_object original = cons(car(stack_get(offset).id),cdr(stack_get(offset).id));
+    lisp_object patch = cons(stack_get(offset),original);
+    inline_patches = cons(patch,inline_patches);
+}
+
+void gc_trace_inline_patches(void) //After the other roots: a patch lives while its cell does
+{
+    bool traced = true;
+    while(traced) { //The original contents of a kept patch may reach other patched cells
+        traced = false;
+        for(lisp_object link = inline_patches;!null(link);link = cdr(link.id)) {
+            const lisp_object patch = car(link.id);
+            if(!broken_heartp(patch.id) && broken_heartp(car(patch.id).id)) {
+                gc_trace(patch);
+                traced = true;
+            }
+        }
+    }
+    while(!null(inline_patches) && !broken_heartp(car(inline_patches.id).id))
+        inline_patches = cdr(inline_patches.id);
+    for(lisp_object link = inline_patches;!null(link);link = cdr(link.id)) //Unlinks the dropped ones in place
+        while(!null(cdr(link.id)) && !broken_heartp(car(cdr(link.id).id).id))
+            set_cdr(link.id,cdr(cdr(link.id).id));
+    inline_patches = gc_trace(inline_patches);
+}
+
+bool pure_primitivep(lisp_object obj)
+{
+    if(!typep(obj,primitive))
+        return false;
+    const primitive_procedure adress = primitive_adress(obj);
+    return adress == prim_car || adress == prim_cdr || adress == prim_add || adress == prim_sub ||
+           adress == prim_mul || adress == prim_div || adress == prim_eq || adress == prim_null;
+}
+
+bool constantp(lisp_object expr)
+{
+    if(typep(expr,cons_cell))
+        return eq(car(expr.id),sym_quote);
+    return !typep(expr,symbol);
+}
+
+lisp_object constant_value(lisp_object expr)
+{
+    return typep(expr,cons_cell) ? cdr(expr.id) : expr;
+}
+
+bool immediatep(lisp_object obj)
+{
+    return typep(obj,fixnum) || typep(obj,boolean) || typep(obj,character) || typep(obj,primitive) || null(obj);
+}
+
+void note_reference(lisp_object sym) //Free in every lambda between the use and the binding
+{
+    const auto found = std::find(optimizer_scope.rbegin(),optimizer_scope.rend(),sym.id);
+    if(found == optimizer_scope.rend())
+        return; //Global
+    const size_t position = optimizer_scope.rend() - found - 1;
+    auto scope = closure_scopes.rbegin();
+    for(;scope != closure_scopes.rend() && scope->scope_start > position;++scope)
+        if(std::find(scope->free.begin(),scope->free.end(),sym.id) == scope->free.end())
+            scope->free.push_back(sym.id);
+    if(scope != closure_scopes.rbegin() && scope != closure_scopes.rend())
+        scope->captures = true; //The binding scope, a closure shares its binding
+    if(scope != closure_scopes.rend() && scope->rest == position)
+        scope->rest_used = true;
+}
+
+void note_capture(void) //The current frame is kept by the expression being optimized
+{
+    if(!closure_scopes.empty())
+        closure_scopes.back().captures = true;
+}
+
+bool push_definitions(lisp_object body) //Internal defines, begin is spliced. True if one is define-syntax
+{
+    bool syntax = false;
+    for(;typep(body,cons_cell);body = cdr(body.id)) {
+        const lisp_object form = car(body.id);
+        if(!typep(form,cons_cell) || !typep(cdr(form.id),cons_cell))
+            continue;
+        const lisp_object head = car(form.id);
+        const lisp_object target = car(cdr(form.id).id);
+        if(eq(head,sym_begin)) {
+            syntax = push_definitions(cdr(form.id)) || syntax;
+        } else if(eq(head,sym_define) || eq(head,sym_define_syntax)) {
+            syntax = syntax || eq(head,sym_define_syntax);
+            if(typep(target,cons_cell))
+                optimizer_scope.push_back(car(target.id).id);
+            else if(typep(target,symbol))
+                optimizer_scope.push_back(target.id);
+        }
+    }
+    return syntax;
+}
+
+bool push_lambda_scope(lisp_object params,lisp_object body,size_t& rest) //Parameters and internal defines
+{
+    for(;typep(params,cons_cell);params = cdr(params.id))
+        optimizer_scope.push_back(car(params.id).id);
+    if(typep(params,symbol)) {
+        rest = optimizer_scope.size();
+        optimizer_scope.push_back(params.id);
+    }
+    return push_definitions(body);
+}
+
+void expand_body_definitions(lisp_object body) //define-record-type defines names, expand it in place first
+{
+    push(body);
+    while(typep(stack_get(0),cons_cell)) {
+        expr = car(stack_get(0).id);
+        if(typep(expr,cons_cell) && eq(car(expr.id),sym_define_record_type))
+            expand_derived();
+        lisp_object next = cdr(stack_pop().id);
+        push(next);
+    }
+    stack_drop(1);
+}
+
+lisp_object free_list(const std::vector<unsigned>& free)
+{
+    lisp_object lst = nil;
+    for(auto id = free.rbegin();id != free.rend();++id)
+        lst = cons(make_obj(symbol,*id),lst);
+    return lst;
+}
+
+void optimize_expr(void);
+
+void optimize_elements(void) //Optimizes every element of the list on the stack top, drops it
+{
+    while(typep(stack_get(0),cons_cell)) {
+        expr = car(stack_get(0).id);
+        optimize_expr();
+        if(!eq(expr,car(stack_get(0).id))) {
+            push(expr);
+            record_patch(1);
+            pop(expr);
+            set_car(stack_get(0).id,expr);
+        }
+        lisp_object next = cdr(stack_pop().id);
+        push(next);
+    }
+    stack_drop(1);
+}
+
+bool optimize_body(lisp_object params,lisp_object body,closure_scope& result) //True if it can be a flat closure
+{
+    push(params);
+    push(body);
+    expand_body_definitions(body);
+    pop(body);
+    pop(params);
+    const size_t scope_size = optimizer_scope.size();
+    size_t rest = no_rest;
+    const bool syntax = push_lambda_scope(params,body,rest);
+    closure_scopes.push_back(closure_scope{scope_size,{},syntax || (!closure_scopes.empty() && closure_scopes.back().opaque),syntax,rest});
+    push(body);
+    optimize_elements();
+    optimizer_scope.resize(scope_size);
+    result = closure_scopes.back();
+    closure_scopes.pop_back();
+    return !result.opaque;
+}
+
+void drop_rest_parameter(void) //The parameters at stack offset 1 end with %rest instead
+{
+    std::vector<lisp_object> fixed; //Symbols do not move
+    for(lisp_object param = stack_get(1);typep(param,cons_cell);param = cdr(param.id)) {
+        if(!typep(car(param.id),symbol))
+            return;
+        fixed.push_back(car(param.id));
+    }
+    reserve_cells(fixed.size());
+    lisp_object params = sym_unused_rest;
+    for(auto param = fixed.rbegin();param != fixed.rend();++param)
+        params = reserved_cons(*param,params);
+    stack[stack_pointer - 2] = params;
+}
+
+lisp_object closure_form(const closure_scope& scope) //Pops params and body, (%closure free params [%stack-frame] . body)
+{
+    if(scope.rest != no_rest && !scope.rest_used)
+        drop_rest_parameter();
+    if(!scope.captures) {
+        lisp_object body = cons(sym_stack_frame,stack_pop());
+        push(body);
+    }
+    lisp_object body = stack_pop();
+    push(cons(stack_pop(),body));
+    lisp_object free_vars = free_list(scope.free);
+    push(cons(free_vars,stack_pop()));
+    return cons(sym_closure,stack_pop());
+}
+
+void make_closure_form(const closure_scope& scope) //The lambda on the stack top becomes a flat closure
+{
+    push(car(cdr(stack_get(0).id).id));
+    push(cdr(cdr(stack_get(1).id).id));
+    push(closure_form(scope));
+    record_patch(1);
+    const lisp_object closure = stack_pop();
+    set_car(stack_get(0).id,car(closure.id));
+    set_cdr(stack_get(0).id,cdr(closure.id));
+}
+
+void fold_call(void) //expr is an application with optimized elements
+{
+    const lisp_object op = car(expr.id);
+    if(!pure_primitivep(op))
+        return;
+    unsigned argc = 0;
+    for(lisp_object arg = cdr(expr.id);typep(arg,cons_cell);arg = cdr(arg.id),++argc)
+        if(!constantp(car(arg.id)))
+            return;
+
+    push(expr);
+    for(lisp_object arg = cdr(expr.id);typep(arg,cons_cell);arg = cdr(arg.id))
+        push(constant_value(car(arg.id)));
+    try {
+        primitive_adress(op)(argc);
+    } catch(SimpleError&) { //Left for the run time error
+        stack_drop(argc);
+        pop(expr);
+        return;
+    }
+    stack_drop(argc);
+    if(immediatep(val)) {
+        stack_drop(1);
+        expr = val; //The caller records its cell
+    } else {
+        push(val);
+        record_patch(1);
+        pop(val);
+        pop(expr);
+        set_car(expr.id,sym_quote);
+        set_cdr(expr.id,val);
+    }
+}
+
+void fold_if(void) //expr is an if with optimized elements
+{
+    const lisp_object rest = cdr(expr.id);
+    if(!typep(rest,cons_cell) || !typep(cdr(rest.id),cons_cell) || !constantp(car(rest.id)))
+        return;
+    const lisp_object alternative = cdr(cdr(rest.id).id);
+    if(truep(constant_value(car(rest.id))))
+        expr = car(cdr(rest.id).id);
+    else if(typep(alternative,cons_cell))
+        expr = car(alternative.id);
+}
+
+void optimize_expr(void) //Result is in expr, the caller stores it
+{
+    if(variablep(expr)) {
+        note_reference(expr);
+        const int index = primitive_index(expr);
+        if(index != -1 && !scopedp(expr) && !redefinedp(expr))
+            expr = make_obj(primitive,index);
+        return;
+    }
+    if(!typep(expr,cons_cell))
+        return;
+
+    const lisp_object head = car(expr.id);
+    if(eq(head,sym_quote)) {
+        return;
+    } else if(eq(head,sym_define_syntax)) {
+        note_capture();
+        for(closure_scope& scope : closure_scopes)
+            scope.opaque = true;
+    } else if(derivedp(expr)) {
+        expand_derived();
+        optimize_expr();
+    } else if(eq(head,sym_lambda)) {
+        if(typep(cdr(expr.id),cons_cell)) {
+            closure_scope scope;
+            push(expr);
+            if(optimize_body(car(cdr(expr.id).id),cdr(cdr(expr.id).id),scope))
+                make_closure_form(scope);
+            else
+                note_capture(); //A plain lambda keeps the whole environment
+            pop(expr);
+        }
+    } else if(eq(head,sym_define) && typep(cdr(expr.id),cons_cell)) {
+        note_capture();
+        push(expr);
+        const lisp_object target = car(cdr(expr.id).id);
+        closure_scope scope;
+        if(typep(target,cons_cell) && optimize_body(cdr(target.id),cdr(cdr(expr.id).id),scope)) {
+            //(define (name . params) . body) becomes (define name (%closure free params . body))
+            push(cdr(car(cdr(stack_get(0).id).id).id));
+            push(cdr(cdr(stack_get(1).id).id));
+            lisp_object closure = closure_form(scope);
+            push(cons(closure,nil));
+            push(cdr(stack_get(1).id));
+            record_patch(0);
+            lisp_object cell = stack_pop();
+            set_car(cell.id,car(car(cell.id).id));
+            set_cdr(cell.id,stack_pop());
+        } else if(!typep(target,cons_cell)) {
+            push(cdr(cdr(expr.id).id));
+            optimize_elements();
+        }
+        pop(expr);
+    } else if(eq(head,sym_set) && typep(cdr(expr.id),cons_cell)) {
+        push(expr);
+        if(variablep(car(cdr(expr.id).id)))
+            note_reference(car(cdr(expr.id).id));
+        push(cdr(cdr(expr.id).id));
+        optimize_elements();
+        pop(expr);
+    } else if(eq(head,sym_begin)) {
+        push(expr);
+        push(cdr(expr.id));
+        optimize_elements();
+        pop(expr);
+    } else if(eq(head,sym_if)) {
+        push(expr);
+        push(cdr(expr.id));
+        optimize_elements();
+        pop(expr);
+        fold_if();
+    } else {
+        if(variablep(head) && !scopedp(head) && primitive_index(head) == -1) {
+            const lisp_object binding = assoc(head,car(global_environment.id));
+            if(!null(binding) && typep(cdr(binding.id),macro)) {
+                val = cdr(binding.id);
+                expand_macro_use();
+                optimize_expr();
+                return;
+            }
+        }
+        if(eq(head,sym_delay) || eq(head,sym_cons_stream))
+            note_capture(); //The promise keeps the environment
+        push(expr);
+        push(expr);
+        optimize_elements();
+        pop(expr);
+        fold_call();
+    }
+}
+
+void optimize(void) //expr is a top-level form, it is replaced by the optimized one
+{
+    optimizer_scope.clear();
+    closure_scopes.clear();
+    optimize_expr();
+}
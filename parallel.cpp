@@ -0,0 +1,268 @@
+//Isolates: persistent worker threads, each with its own heap, registers and stack
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include "lisp.hpp"
+
+struct isolate_job
+{
+    message request; //(procedure . arguments) for a map chunk, thunk for a future
+    message reply;
+    bool map;
+    bool done;
+    const char* error;
+};
+
+//Never destroyed: detached workers still wait on them while the program exits
+std::mutex& jobs_lock = *new std::mutex;
+std::condition_variable& jobs_ready = *new std::condition_variable;
+std::condition_variable& jobs_done = *new std::condition_variable;
+std::deque<std::shared_ptr<isolate_job>>& jobs = *new std::deque<std::shared_ptr<isolate_job>>;
+unsigned workers_count = 0;
+
+//Futures
+/*
+    A future is a cell: (slot . generation) while pending, (#t . value) or (#f . error) once touched.
+    The first touch frees its slot in futures, the generation tells a reused slot from the old one,
+    so a copy sent to another isolate before that touch reports an error instead of another result.
+    Errors are message literals, kept in future_errors.
+*/
+
+struct future_slot
+{
+    std::shared_ptr<isolate_job> job; //Null when free
+    unsigned generation;
+};
+
+std::vector<future_slot> futures; //Under jobs_lock, as the two below
+std::vector<unsigned> free_futures;
+std::vector<const char*> future_errors;
+
+void reverse_argl(void)
+{
+    val = nil;
+    while(!null(argl)) {
+        lisp_object next = cdr(argl.id);
+        set_cdr(argl.id,val);
+        val = argl;
+        argl = next;
+    }
+}
+
+void run_job(isolate_job& job)
+{
+    val = receive_message(job.request);
+    if(job.map) {
+        proc = car(val.id);
+        unev = cdr(val.id);
+        argl = nil;
+        while(!null(unev)) {
+            push(proc);
+            push(unev);
+            push(car(unev.id));
+            apply_procedure(1);
+            pop(proc);
+            argl = cons(val,argl);
+            unev = cdr(unev.id);
+        }
+        reverse_argl();
+    } else {
+        proc = val;
+        push(unev);
+        apply_procedure(0);
+    }
+    message_begin(job.reply,false);
+    message_end(message_copy(val));
+}
+
+void isolate_main(void)
+{
+    init_isolate_memory();
+    init_global_env();
+    while(true) {
+        std::shared_ptr<isolate_job> job;
+        {
+            std::unique_lock<std::mutex> guard(jobs_lock);
+            jobs_ready.wait(guard,[]{return !jobs.empty();});
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        const char* error = nullptr;
+        try {
+            run_job(*job);
+        } catch(SimpleError& err) {
+            error = err.what();
+        } catch(...) {
+            error = "isolate: evaluation failed";
+        }
+        if(error) {
+            stack_set(0);
+            env = global_environment;
+        }
+        std::lock_guard<std::mutex> guard(jobs_lock);
+        job->error = error;
+        job->done = true;
+        jobs_done.notify_all();
+    }
+}
+
+void start_isolates(void)
+{
+    if(workers_count)
+        return;
+    workers_count = std::max(1u,std::thread::hardware_concurrency());
+    for(unsigned i = 0;i < workers_count;++i)
+        std::thread(isolate_main).detach();
+}
+
+void submit_job(const std::shared_ptr<isolate_job>& job)
+{
+    std::lock_guard<std::mutex> guard(jobs_lock);
+    jobs.push_back(job);
+    jobs_ready.notify_one();
+}
+
+void wait_job(isolate_job& job)
+{
+    std::unique_lock<std::mutex> guard(jobs_lock);
+    jobs_done.wait(guard,[&job]{return job.done;});
+}
+
+bool procedurep(lisp_object obj)
+{
+    return typep(obj,compound) || typep(obj,primitive);
+}
+
+//Primitives
+
+void prim_parallel_map(unsigned num)
+{
+    if(num != 2 || !procedurep(stack_get(1)))
+        throw SimpleError("parallel-map: procedure and list awaited");
+    unsigned count = 0;
+    for(lisp_object lst = stack_get(0);!null(lst);lst = cdr(lst.id)) {
+        if(!typep(lst,cons_cell))
+            throw SimpleError("parallel-map: arg must be proper list");
+        ++count;
+    }
+    start_isolates();
+
+    //No allocation in this heap until all requests are built
+    const unsigned chunk = (count + workers_count - 1) / workers_count;
+    std::vector<std::shared_ptr<isolate_job>> batch;
+    lisp_object lst = stack_get(0);
+    while(!null(lst)) {
+        auto job = std::make_shared<isolate_job>();
+        job->map = true;
+        message_begin(job->request,true);
+        lisp_object procedure = message_copy(stack_get(1));
+        std::vector<lisp_object> elements;
+        for(unsigned i = 0;i < chunk && !null(lst);++i,lst = cdr(lst.id))
+            elements.push_back(message_copy(car(lst.id)));
+        lisp_object args = nil;
+        for(auto element = elements.rbegin();element != elements.rend();++element)
+            args = message_cons(*element,args);
+        message_end(message_cons(procedure,args));
+        batch.push_back(job);
+        submit_job(job);
+    }
+
+    const char* error = nullptr;
+    for(auto& job : batch) {
+        wait_job(*job);
+        if(job->error)
+            error = job->error;
+    }
+    if(error)
+        throw SimpleError(error);
+
+    for(auto& job : batch)
+        push(receive_message(job->reply));
+    val = nil;
+    for(unsigned i = 0;i < batch.size();++i) { //Chunks are linked from the last one
+        lisp_object result = stack_get(i);
+        if(null(result))
+            continue;
+        lisp_object last = result;
+        while(!null(cdr(last.id)))
+            last = cdr(last.id);
+        set_cdr(last.id,val);
+        val = result;
+    }
+    stack_drop(batch.size());
+}
+
+void prim_future(unsigned num)
+{
+    if(num != 1 || !procedurep(stack_get(0)))
+        throw SimpleError("future: procedure of no args awaited");
+    start_isolates();
+    auto job = std::make_shared<isolate_job>();
+    job->map = false;
+    message_begin(job->request,true);
+    message_end(message_copy(stack_get(0)));
+
+    val = make_obj(future,cons(nil,nil).id);
+    {
+        std::lock_guard<std::mutex> guard(jobs_lock);
+        if(free_futures.empty()) {
+            futures.push_back(future_slot{nullptr,0});
+            free_futures.push_back(futures.size() - 1);
+        }
+        const unsigned slot = free_futures.back();
+        free_futures.pop_back();
+        futures[slot].job = job;
+        set_car(val.id,number(slot));
+        set_cdr(val.id,number(futures[slot].generation));
+    }
+    submit_job(job);
+}
+
+std::shared_ptr<isolate_job> future_job(lisp_object obj) //Null once the slot is freed
+{
+    std::lock_guard<std::mutex> guard(jobs_lock);
+    const unsigned slot = car(obj.id).id;
+    if(slot >= futures.size() || !eq(cdr(obj.id),number(futures[slot].generation)))
+        return nullptr;
+    return futures[slot].job;
+}
+
+lisp_object release_future(unsigned slot,const std::shared_ptr<isolate_job>& job) //The index of its error
+{
+    std::lock_guard<std::mutex> guard(jobs_lock);
+    if(futures[slot].job == job) { //Not yet by another green thread
+        futures[slot] = future_slot{nullptr,futures[slot].generation + 1};
+        free_futures.push_back(slot);
+    }
+    if(!job->error)
+        return nil;
+    const unsigned index = std::find(future_errors.begin(),future_errors.end(),job->error) - future_errors.begin();
+    if(index == future_errors.size())
+        future_errors.push_back(job->error);
+    return number(index);
+}
+
+void prim_touch(unsigned num) //Waits for the value of a future, computed once
+{
+    if(num != 1 || !typep(stack_get(0),future))
+        throw SimpleError("touch: future awaited");
+    if(typep(car(stack_get(0).id),fixnum)) {
+        const std::shared_ptr<isolate_job> job = future_job(stack_get(0));
+        if(!job)
+            throw SimpleError("touch: future touched in another isolate");
+        wait_job(*job);
+        const lisp_object error = release_future(car(stack_get(0).id).id,job);
+        val = null(error) ? receive_message(job->reply) : error;
+        set_car(stack_get(0).id,null(error) ? val_true : val_false);
+        set_cdr(stack_get(0).id,val);
+    }
+    const lisp_object obj = stack_get(0);
+    if(eq(car(obj.id),val_false)) {
+        std::lock_guard<std::mutex> guard(jobs_lock);
+        throw SimpleError(future_errors[cdr(obj.id).id]);
+    }
+    val = cdr(obj.id);
+}
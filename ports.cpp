@@ -0,0 +1,424 @@
+//Ports: non-blocking files and sockets driven by an epoll event loop
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "lisp.hpp"
+
+/*
+    A port is a non-blocking descriptor with an input buffer.
+    An operation that would block watches the descriptor and blocks the current green thread.
+    poll_descriptors wakes the threads waiting on ready descriptors: the scheduler calls it
+    at each preemption, and waits in it when no thread can run.
+    Regular files cannot be watched, they are always ready.
+    read-string and read-line return #f at end of file.
+    An output string port has no descriptor: write-string appends to its buffer.
+    A port is a cell (slot . generation). close-port frees the slot for the next port, the
+    generation tells it from the closed one. The collector closes the open ports whose cell
+    nothing reaches, see gc_sweep_ports.
+*/
+
+const int string_port_fd = -2;
+
+struct port_state
+{
+    int fd; //-1 once closed
+    bool socket;
+    std::string input; //Read ahead by read-line
+    std::string output; //Of a string port
+    unsigned generation;
+    lisp_object handle; //The port cell while open, not a root
+};
+
+struct descriptor_wait
+{
+    uint32_t events;
+    std::vector<unsigned> threads;
+};
+
+thread_local std::vector<port_state> ports;
+thread_local std::vector<unsigned> free_ports;
+thread_local std::unordered_map<int,descriptor_wait> descriptor_waits;
+thread_local int epoll_fd = -1;
+
+bool poll_descriptors(int timeout) //False if no descriptor is watched
+{
+    if(descriptor_waits.empty())
+        return false;
+    epoll_event events[64];
+    int count = 0;
+    if((count = epoll_wait(epoll_fd,events,64,timeout)) < 0) {
+        if(errno != EINTR)
+            throw SimpleError("event loop: epoll_wait failed");
+        count = 0; //A signal, the caller checks its limits
+    }
+    for(int i = 0;i < count;++i) {
+        const auto found = descriptor_waits.find(events[i].data.fd);
+        if(found == descriptor_waits.end())
+            continue;
+        for(unsigned thread : found->second.threads)
+            wake_thread(thread);
+        epoll_ctl(epoll_fd,EPOLL_CTL_DEL,found->first,nullptr);
+        descriptor_waits.erase(found);
+    }
+    return true;
+}
+
+void wait_descriptor(int fd,uint32_t events) //Blocks the current thread until fd is ready
+{
+    if(epoll_fd == -1 && (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        throw SimpleError("event loop: cannot create epoll instance");
+    descriptor_wait& wait = descriptor_waits[fd];
+    epoll_event event = {};
+    event.events = wait.events | events;
+    event.data.fd = fd;
+    if(epoll_ctl(epoll_fd,wait.threads.empty() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,fd,&event) != 0) {
+        const int error = errno;
+        if(wait.threads.empty())
+            descriptor_waits.erase(fd);
+        if(error == EPERM)
+            return; //Regular file
+        throw SimpleError("event loop: cannot watch descriptor");
+    }
+    wait.events = event.events;
+    const unsigned self = running_thread();
+    wait.threads.push_back(self);
+    wait_until([fd,self]{
+        const auto found = descriptor_waits.find(fd);
+        return found == descriptor_waits.end() ||
+               std::find(found->second.threads.begin(),found->second.threads.end(),self) == found->second.threads.end();
+    },"event loop: no thread can run");
+}
+
+lisp_object make_port(int fd,bool socket) //Closes fd if the cell cannot be allocated
+{
+    lisp_object handle;
+    try {
+        handle = make_obj(port,cons(nil,nil).id);
+    } catch(...) {
+        if(fd >= 0)
+            close(fd);
+        throw;
+    }
+    if(free_ports.empty()) {
+        ports.push_back(port_state{-1,false,{},{},0,nil});
+        free_ports.push_back(ports.size() - 1);
+    }
+    const unsigned slot = free_ports.back();
+    free_ports.pop_back();
+    port_state& state = ports[slot];
+    state.fd = fd;
+    state.socket = socket;
+    state.handle = handle;
+    set_car(handle.id,number(slot));
+    set_cdr(handle.id,number(state.generation));
+    return handle;
+}
+
+unsigned port_index(lisp_object obj,const char* msg) //Ports may be added while a thread waits, keep the index
+{
+    if(!typep(obj,port) || !typep(car(obj.id),fixnum))
+        throw SimpleError(msg);
+    const unsigned slot = car(obj.id).id;
+    if(slot >= ports.size() || ports[slot].fd == -1 || !eq(cdr(obj.id),number(ports[slot].generation)))
+        throw SimpleError(msg);
+    return slot;
+}
+
+void release_port(unsigned index) //Closes it, threads waiting on it get an error
+{
+    const int fd = ports[index].fd;
+    if(fd != string_port_fd) {
+        const auto found = descriptor_waits.find(fd);
+        if(found != descriptor_waits.end()) {
+            for(unsigned thread : found->second.threads)
+                wake_thread(thread);
+            epoll_ctl(epoll_fd,EPOLL_CTL_DEL,fd,nullptr);
+            descriptor_waits.erase(found);
+        }
+        close(fd);
+    }
+    port_state& state = ports[index];
+    state.fd = -1;
+    state.input = std::string(); //Releases the buffers
+    state.output = std::string();
+    state.handle = nil;
+    ++state.generation;
+    free_ports.push_back(index);
+}
+
+void gc_sweep_ports(void) //After tracing: an open port whose cell was not reached is closed
+{
+    for(unsigned i = 0;i < ports.size();++i) {
+        if(ports[i].fd == -1)
+            continue;
+        if(broken_heartp(ports[i].handle.id))
+            ports[i].handle = gc_trace(ports[i].handle); //Its new address
+        else
+            release_port(i);
+    }
+}
+
+std::string string_arg(lisp_object obj,const char* msg)
+{
+    if(!typep(obj,lisp_string))
+        throw SimpleError(msg);
+    return std::string(reinterpret_cast<char*>(deref_string(obj)),vector_length(obj));
+}
+
+bool fill_input(unsigned index) //Appends what can be read, waiting for it. False at end of file
+{
+    if(ports[index].fd == string_port_fd)
+        return false;
+    char buffer[4096];
+    while(true) {
+        const ssize_t count = read(ports[index].fd,buffer,sizeof(buffer));
+        if(count > 0) {
+            ports[index].input.append(buffer,count);
+            return true;
+        }
+        if(count == 0)
+            return false;
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            wait_descriptor(ports[index].fd,EPOLLIN);
+        else if(errno != EINTR)
+            throw SimpleError("read: input error");
+    }
+}
+
+//Sockets
+
+int make_socket(int domain)
+{
+    const int fd = socket(domain,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+    if(fd == -1)
+        throw SimpleError("socket: cannot create socket");
+    return fd;
+}
+
+sockaddr_un unix_address(lisp_object path,const char* msg)
+{
+    const std::string name = string_arg(path,msg);
+    sockaddr_un address = {};
+    if(name.empty() || name.size() >= sizeof(address.sun_path))
+        throw SimpleError(msg);
+    address.sun_family = AF_UNIX;
+    std::copy(name.begin(),name.end(),address.sun_path);
+    return address;
+}
+
+sockaddr_in loopback_address(lisp_object number,const char* msg)
+{
+    if(!typep(number,fixnum) || number.id > 65535)
+        throw SimpleError(msg);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(number.id);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+void listen_on(int fd,const sockaddr* address,socklen_t length,const char* msg)
+{
+    if(bind(fd,address,length) != 0 || listen(fd,SOMAXCONN) != 0) {
+        close(fd);
+        throw SimpleError(msg);
+    }
+    val = make_port(fd,true);
+}
+
+void connect_to(int fd,const sockaddr* address,socklen_t length,const char* msg)
+{
+    if(connect(fd,address,length) != 0) {
+        if(errno != EINPROGRESS) {
+            close(fd);
+            throw SimpleError(msg);
+        }
+        int error = 0;
+        socklen_t error_length = sizeof(error);
+        wait_descriptor(fd,EPOLLOUT);
+        if(getsockopt(fd,SOL_SOCKET,SO_ERROR,&error,&error_length) != 0 || error != 0) {
+            close(fd);
+            throw SimpleError(msg);
+        }
+    }
+    val = make_port(fd,true);
+}
+
+//Primitives
+
+void open_file(unsigned num,int flags,const char* msg)
+{
+    if(num != 1)
+        throw SimpleError(msg);
+    const std::string path = string_arg(stack_get(0),msg);
+    const int fd = open(path.c_str(),flags | O_NONBLOCK | O_CLOEXEC,0644);
+    if(fd == -1)
+        throw SimpleError(msg);
+    val = make_port(fd,false);
+}
+
+void prim_open_input_file(unsigned num)
+{
+    open_file(num,O_RDONLY,"open-input-file: cannot open file");
+}
+
+void prim_open_output_file(unsigned num)
+{
+    open_file(num,O_WRONLY | O_CREAT | O_TRUNC,"open-output-file: cannot open file");
+}
+
+void prim_unix_listen(unsigned num) //(unix-listen path), a socket left at path is replaced
+{
+    if(num != 1)
+        throw SimpleError("unix-listen: path awaited");
+    const sockaddr_un address = unix_address(stack_get(0),"unix-listen: path awaited");
+    struct stat status;
+    if(stat(address.sun_path,&status) == 0 && S_ISSOCK(status.st_mode))
+        unlink(address.sun_path);
+    listen_on(make_socket(AF_UNIX),reinterpret_cast<const sockaddr*>(&address),sizeof(address),"unix-listen: cannot listen");
+}
+
+void prim_unix_connect(unsigned num)
+{
+    if(num != 1)
+        throw SimpleError("unix-connect: path awaited");
+    const sockaddr_un address = unix_address(stack_get(0),"unix-connect: path awaited");
+    connect_to(make_socket(AF_UNIX),reinterpret_cast<const sockaddr*>(&address),sizeof(address),"unix-connect: cannot connect");
+}
+
+void prim_tcp_listen(unsigned num) //(tcp-listen port) on the loopback interface
+{
+    if(num != 1)
+        throw SimpleError("tcp-listen: port number awaited");
+    const sockaddr_in address = loopback_address(stack_get(0),"tcp-listen: port number awaited");
+    const int fd = make_socket(AF_INET);
+    const int reuse = 1;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
+    listen_on(fd,reinterpret_cast<const sockaddr*>(&address),sizeof(address),"tcp-listen: cannot listen");
+}
+
+void prim_tcp_connect(unsigned num) //(tcp-connect port) on the loopback interface
+{
+    if(num != 1)
+        throw SimpleError("tcp-connect: port number awaited");
+    const sockaddr_in address = loopback_address(stack_get(0),"tcp-connect: port number awaited");
+    connect_to(make_socket(AF_INET),reinterpret_cast<const sockaddr*>(&address),sizeof(address),"tcp-connect: cannot connect");
+}
+
+void prim_accept(unsigned num) //Waits for a connection on a listening port
+{
+    if(num != 1)
+        throw SimpleError("accept: port awaited");
+    const unsigned index = port_index(stack_get(0),"accept: port awaited");
+    int fd = -1;
+    while((fd = accept4(ports[index].fd,nullptr,nullptr,SOCK_NONBLOCK | SOCK_CLOEXEC)) == -1) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            wait_descriptor(ports[index].fd,EPOLLIN);
+        else if(errno != EINTR)
+            throw SimpleError("accept: cannot accept connection");
+    }
+    val = make_port(fd,true);
+}
+
+void prim_read_string(unsigned num) //(read-string port n) reads at most n bytes, waiting for at least one
+{
+    if(num != 2 || !typep(stack_get(0),fixnum))
+        throw SimpleError("read-string: port and count awaited");
+    const unsigned index = port_index(stack_get(1),"read-string: port awaited");
+    if(ports[index].input.empty() && !fill_input(index)) {
+        val = val_false;
+        return;
+    }
+    std::string& input = ports[index].input;
+    const unsigned count = std::min<size_t>(stack_get(0).id,input.size());
+    val = make_string(count,input.data());
+    input.erase(0,count);
+}
+
+void prim_read_line(unsigned num) //The line without its newline
+{
+    if(num != 1)
+        throw SimpleError("read-line: port awaited");
+    const unsigned index = port_index(stack_get(0),"read-line: port awaited");
+    size_t newline = 0;
+    while((newline = ports[index].input.find('\n')) == std::string::npos) {
+        if(!fill_input(index)) {
+            newline = ports[index].input.size();
+            if(!newline) {
+                val = val_false;
+                return;
+            }
+            break;
+        }
+    }
+    std::string& input = ports[index].input;
+    val = make_string(newline,input.data());
+    input.erase(0,std::min(newline + 1,input.size()));
+}
+
+void prim_write_string(unsigned num) //(write-string string [port]) writes all of it, to stdout without a port
+{
+    if(num < 1 || num > 2 || !typep(stack_get(num - 1),lisp_string))
+        throw SimpleError("write-string: string and port awaited");
+    if(num == 1) {
+        fwrite(deref_string(stack_get(0)),1,vector_length(stack_get(0)),stdout);
+        val = stack_get(0);
+        return;
+    }
+    const unsigned index = port_index(stack_get(0),"write-string: port awaited");
+    if(ports[index].fd == string_port_fd) {
+        ports[index].output.append(reinterpret_cast<char*>(deref_string(stack_get(1))),vector_length(stack_get(1)));
+        val = stack_get(1);
+        return;
+    }
+    size_t written = 0;
+    while(written < vector_length(stack_get(1))) { //The string may move while the thread waits
+        const char* data = reinterpret_cast<char*>(deref_string(stack_get(1))) + written;
+        const size_t length = vector_length(stack_get(1)) - written;
+        const ssize_t count = ports[index].socket ? send(ports[index].fd,data,length,MSG_NOSIGNAL) :
+                                                    write(ports[index].fd,data,length);
+        if(count >= 0)
+            written += count;
+        else if(errno == EAGAIN || errno == EWOULDBLOCK)
+            wait_descriptor(ports[index].fd,EPOLLOUT);
+        else if(errno != EINTR)
+            throw SimpleError("write-string: output error");
+    }
+    val = stack_get(1);
+}
+
+void prim_close_port(unsigned num) //Threads waiting on it get an error
+{
+    if(num != 1)
+        throw SimpleError("close-port: port awaited");
+    release_port(port_index(stack_get(0),"close-port: port awaited"));
+    val = val_true;
+}
+
+void prim_open_output_string(unsigned num)
+{
+    if(num != 0)
+        throw SimpleError("open-output-string: no args awaited");
+    val = make_port(string_port_fd,false);
+}
+
+void prim_get_output_string(unsigned num) //What was written so far
+{
+    if(num != 1)
+        throw SimpleError("get-output-string: string port awaited");
+    const unsigned index = port_index(stack_get(0),"get-output-string: string port awaited");
+    if(ports[index].fd != string_port_fd)
+        throw SimpleError("get-output-string: string port awaited");
+    val = make_string(ports[index].output.size(),ports[index].output.data());
+}
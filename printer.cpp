@@ -0,0 +1,80 @@
+//Printer
+#include <cstdio>
+#include "lisp.hpp"
+
+void print_cons(lisp_object pair)
+{
+    putchar('(');
+    while(typep(pair,cons_cell)) {
+        print_obj(car(pair.id));
+        if (typep(cdr(pair.id),cons_cell))
+             putchar(' ');
+        pair = cdr(pair.id);
+    }
+    if (!null(pair)) {
+        printf(" . ");
+        print_obj(pair);
+    }
+
+    putchar(')');
+}
+
+void print_obj(lisp_object val)
+{
+    if(typep(val,fixnum)){
+        int flag = val.id&fixnum_negative_flag;
+        int value = (val.id^(-fixnum_negative_flag))*(flag ? -1 : 1);
+        printf("%llu",static_cast<unsigned long long>(val.id));
+    } else if (typep(val,cons_cell)) {
+        print_cons(val);
+    } else if (typep(val,symbol)) {
+            printf("%s",get_symbol(val.id));
+    } else if (typep(val,boolean)) {
+            if(val.id) {
+                printf("#t");
+            } else printf("#f");
+    } else if(typep(val,character)) {
+        printf("#\\%c",(unsigned char)val.id);
+    } else if(typep(val,lisp_string)) {
+        char* str = reinterpret_cast<char*>(deref_string(val));
+        putchar('"');
+        for(size_t i = 0;i < vector_length(val);++i) {
+            putchar(str[i]);
+        }
+        putchar('"');
+    } else if(typep(val,macro)) {
+        printf("#<macro>");
+    } else if(typep(val,record)) {
+        printf("#<record %s>",get_symbol(car(deref_vector(val)[0].id).id));
+    } else if(typep(val,promise)) {
+        printf("#<promise>");
+    } else if(typep(val,continuation)) {
+        printf("#<continuation>");
+#ifdef LISP_NAN_BOXING
+    } else if(typep(val,double_float)) {
+        printf("%g",double_float_value(val));
+#endif
+    } else if(typep(val,future)) {
+        printf("#<future>");
+    } else if(typep(val,thread)) {
+        if(typep(car(val.id),fixnum)) //Running, its slot
+            printf("#<thread %u>",static_cast<unsigned>(car(val.id).id));
+        else
+            printf("#<thread>");
+    } else if(typep(val,channel)) {
+        printf("#<channel>");
+    } else if(typep(val,port)) {
+        if(typep(car(val.id),fixnum)) //Its slot
+            printf("#<port %u>",static_cast<unsigned>(car(val.id).id));
+        else
+            printf("#<port>");
+    } else {
+        printf("Type: %u, ID: %llu",static_cast<unsigned>(object_type(val)),static_cast<unsigned long long>(val.id));
+    }
+}
+
+void print(void)
+{
+    print_obj(val);
+    putchar('\n');
+}
@@ -0,0 +1,169 @@
+#include <cstring>
+#include <cctype>
+#include <string>
+#include "lisp.hpp"
+
+//Reader
+/*
+    Expression = Atom | SExp
+    SExp = Expression * Expression [. Expression]
+    Atom = Number | Symbol | String
+*/
+
+FILE* read_port = stdin;
+int read_char;
+
+void pass_space(void) //And comments, from ; to the end of the line
+{
+    while(isspace(read_char) || read_char == ';') {
+        if(read_char == ';') {
+            while(read_char != '\n' && read_char != EOF)
+                read_char = getc(read_port);
+        } else {
+            read_char = getc(read_port);
+        }
+    }
+}
+
+const object_word max_literal = (object_word(1) << (object_id_bits - 1)) - 1; //Largest positive fixnum
+
+void read_number(void)
+{
+    object_word num = 0;
+    bool fits = true;
+    while(isdigit(read_char)) {
+        const object_word digit = read_char - '0';
+        fits = fits && num <= (max_literal - digit)/10;
+        if(fits)
+            num = num*10 + digit;
+        read_char = getc(read_port);
+    }
+    if(!fits)
+        throw SimpleError("read: number out of fixnum range");
+    val = number(num);
+}
+
+void read_string(void)
+{
+    std::string str;
+    while((read_char = getc(read_port)) != '"') {
+        if(read_char == EOF)
+            throw SimpleError("read: unexpected end of input");
+        str.push_back(read_char);
+    }
+    read_char = getc(read_port);
+    val = make_string(str.size(),str.data());
+}
+
+void read_symbol(void)
+{
+    char* name = new char[64];
+    unsigned len = 0;
+    while(read_char != '(' && read_char != ')' && read_char != ';' && !isspace(read_char) && read_char != EOF && len < 63)  {
+        name[len++] = read_char;
+        read_char = getc(read_port);
+    }
+    name[len] = '\0';
+
+    int id = symbol_id(name);
+
+    if(same_strings(name,"#t") || same_strings(name,"#f")) {
+        val = name[1] == 't' ? val_true : val_false;
+    } else if(id != -1) {
+        val = make_obj(symbol,id);
+    } else {
+        char* new_location = new char[len+1];
+        strcpy(new_location,name);
+        val = make_symbol(new_location);
+    }
+    delete[] name;
+}
+
+void read_expr(void);
+
+bool dotp(void) //A lone dot, not the start of a symbol such as ...
+{
+    if(read_char != '.')
+        return false;
+    const int next = getc(read_port);
+    ungetc(next,read_port);
+    return isspace(next) || next == '(' || next == ')';
+}
+
+void read_sexpr(void) //After '(': elements wait on the stack, the list is built at ')'
+{
+    unsigned count = 0;
+    bool dotted = false;
+    try {
+        for(pass_space();read_char != ')';pass_space()) {
+            if(read_char == EOF)
+                throw SimpleError("read: unexpected end of input");
+            if(dotp()) { //(a b . tail)
+                read_char = getc(read_port);
+                pass_space();
+                if(count == 0 || read_char == ')' || read_char == EOF)
+                    throw SimpleError("read: bad dotted list");
+                read_expr();
+                push(val);
+                dotted = true;
+                pass_space();
+                if(read_char != ')')
+                    throw SimpleError("read: bad dotted list");
+                break;
+            }
+            read_expr();
+            push(val);
+            ++count;
+        }
+        reserve_cells(count);
+    } catch(SimpleError&) { //Errors from nested lists and atoms too
+        stack_drop(count + dotted);
+        throw;
+    }
+    read_char = getc(read_port);
+    val = dotted ? stack_pop() : nil;
+    while(count--)
+        val = reserved_cons(stack_pop(),val);
+}
+
+void read_expr(void)
+{
+    pass_space();
+
+    if (read_char == '(') {
+        read_char = getc(read_port);
+        read_sexpr();
+    } else if (read_char == ')') { //Already taken from the port, so the next read goes on after it
+        throw SimpleError("read: unexpected )");
+    } else if (isdigit(read_char)) {
+        read_number();
+    } else if (read_char == '\'') {
+        read_char = getc(read_port);
+        read_expr();
+        val = cons(sym_quote,val);
+    } else if (read_char == '"') {
+        read_string();
+    } else {
+        read_symbol();
+    }
+}
+
+bool read(void) //The character after the form goes back to the port, it may start the next one
+{
+    read_char = getc(read_port);
+    pass_space();
+    if(read_char == EOF)
+        return false;
+    read_expr();
+    if(read_char != EOF)
+        ungetc(read_char,read_port);
+    expr = val;
+    val = nil;
+    return true;
+}
+
+void read_skip_line(void) //After a read error: the rest of the form is dropped with its line
+{
+    while(read_char != '\n' && read_char != EOF)
+        read_char = getc(read_port);
+}
@@ -0,0 +1,90 @@
+//Safepoints: interruption and limits of a top-level evaluation
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include "lisp.hpp"
+
+/*
+    Evaluation is only stopped at safepoints, where the registers and the stack are consistent:
+    preempt, which eval and jit_apply reach once quantum_left is spent, and wait_until.
+    So a limit is seen within a thread quantum of eval steps and allocated cells.
+    check_limits throws interruption, a SimpleError: the REPL, load and the embedding API
+    unwind it as any run time error. Thread 0 first lets the other green threads run until
+    they stop at their own safepoint, so none is left in the middle of the evaluation.
+    An interrupt request stops every isolate, limits belong to the isolate that set them.
+    Both hold until the next top-level evaluation starts.
+*/
+
+std::atomic<bool> interrupt_requested(false);
+
+thread_local unsigned long long eval_steps = 0;
+thread_local unsigned evaluation_depth = 0;
+thread_local evaluation_limits limits;
+thread_local unsigned long long step_start = 0, cell_start = 0;
+thread_local std::chrono::steady_clock::time_point deadline;
+
+evaluation_scope::evaluation_scope(const evaluation_limits& new_limits)
+{
+    if(evaluation_depth++ > 0)
+        return;
+    interrupt_requested = false;
+    limits = new_limits;
+    step_start = eval_steps;
+    cell_start = allocated_cells();
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(limits.time_ms);
+}
+
+evaluation_scope::~evaluation_scope()
+{
+    if(--evaluation_depth == 0)
+        limits = evaluation_limits();
+}
+
+const char* limit_reached(void)
+{
+    if(interrupt_requested.load(std::memory_order_relaxed))
+        return "interrupted";
+    if(limits.steps && eval_steps - step_start > limits.steps)
+        return "step limit exceeded";
+    if(limits.cells && allocated_cells() - cell_start > limits.cells)
+        return "allocation limit exceeded";
+    if(limits.time_ms && std::chrono::steady_clock::now() >= deadline)
+        return "time limit exceeded";
+    return nullptr;
+}
+
+void check_limits(void)
+{
+    const char* reason = limit_reached();
+    if(!reason)
+        return;
+    stop_threads();
+    throw interruption(reason);
+}
+
+int limits_timeout(void) //For a blocking wait: ms until the deadline, -1 without one
+{
+    if(!limits.time_ms)
+        return -1;
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return std::max(0,static_cast<int>(std::min<long long>(left.count() + 1,1 << 30)));
+}
+
+void request_interrupt(void) //Async-signal-safe
+{
+    interrupt_requested.store(true,std::memory_order_relaxed);
+}
+
+void handle_interrupt(int)
+{
+    request_interrupt();
+}
+
+void catch_interrupts(bool enable) //SIGINT stops the evaluation instead of the process
+{
+    struct sigaction action = {};
+    action.sa_handler = enable ? handle_interrupt : SIG_DFL;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT,&action,nullptr); //No SA_RESTART: epoll_wait returns to wait_until
+}
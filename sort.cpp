@@ -0,0 +1,161 @@
+//Stable sorting of lists and vectors
+#include <algorithm>
+#include "lisp.hpp"
+
+/*
+    (sort seq less?) sorts a copy, (sort! seq less?) reuses seq: a list is sorted by relinking
+    its own cells. Elements a and b stay in order unless (less? b a).
+    With < or > on fixnums, std::stable_sort runs on the elements and no procedure is called.
+    Otherwise a bottom-up merge sort calls less? back: as it may collect, the elements and a
+    buffer of the same length are vectors kept on the stack. A list is first spread into such
+    a vector, as its cells. At most 2n cells are allocated whatever the comparisons.
+*/
+
+lisp_object sort_key(lisp_object element,bool cells)
+{
+    return cells ? car(element.id) : element;
+}
+
+bool fixnum_comparator(lisp_object less,bool& descending) //< or > as primitives
+{
+    if(!typep(less,primitive))
+        return false;
+    descending = primitive_adress(less) == prim_greater;
+    return descending || primitive_adress(less) == prim_less;
+}
+
+bool sort_fixnums(lisp_object* begin,lisp_object* end,lisp_object less,bool cells) //False if not applicable
+{
+    bool descending;
+    if(!fixnum_comparator(less,descending))
+        return false;
+    for(lisp_object* element = begin;element != end;++element)
+        if(!numberp(sort_key(*element,cells)))
+            return false;
+    std::stable_sort(begin,end,[cells,descending](lisp_object x,lisp_object y) {
+        const long long a = fixnum_value(sort_key(x,cells)), b = fixnum_value(sort_key(y,cells));
+        return descending ? b < a : a < b;
+    });
+    return true;
+}
+
+bool precedes(unsigned less,unsigned from,unsigned i,unsigned j,bool cells) //(less? element_i element_j)
+{
+    push(unev);
+    push(sort_key(deref_vector(stack[from])[i],cells));
+    push(sort_key(deref_vector(stack[from])[j],cells));
+    call_back(less,2);
+    return truep(val);
+}
+
+void merge_runs(unsigned less,unsigned from,unsigned to,unsigned width,bool cells) //Runs of width into runs of 2 width
+{
+    const unsigned length = vector_length(stack[from]);
+    for(unsigned start = 0;start < length;start += 2 * width) {
+        const unsigned middle = std::min(start + width,length), end = std::min(start + 2 * width,length);
+        if(middle == end || !precedes(less,from,middle,middle - 1,cells)) { //A single run, or already in order
+            std::copy(deref_vector(stack[from]) + start,deref_vector(stack[from]) + end,deref_vector(stack[to]) + start);
+            continue;
+        }
+        unsigned left = start, right = middle, out = start;
+        while(left < middle && right < end) {
+            const bool right_first = precedes(less,from,right,left,cells);
+            const lisp_object* source = deref_vector(stack[from]); //Read again, the call may have collected
+            deref_vector(stack[to])[out++] = right_first ? source[right++] : source[left++];
+        }
+        const lisp_object* source = deref_vector(stack[from]);
+        lisp_object* target = std::copy(source + left,source + middle,deref_vector(stack[to]) + out);
+        std::copy(source + right,source + end,target);
+    }
+}
+
+void sort_elements(unsigned elements,unsigned less,bool cells) //The vector at stack[elements], in place
+{
+    const unsigned length = vector_length(stack[elements]);
+    lisp_object* begin = deref_vector(stack[elements]);
+    if(length < 2 || sort_fixnums(begin,begin + length,stack[less],cells))
+        return;
+    reserve_cells(vector_cells(length));
+    push(make_obj(lisp_vector,allocate_vector(length)));
+    unsigned from = elements, to = stack_pointer - 1;
+    for(unsigned width = 1;width < length;width *= 2) {
+        merge_runs(less,from,to,width,cells);
+        std::swap(from,to);
+    }
+    if(from != elements)
+        std::copy(deref_vector(stack[from]),deref_vector(stack[from]) + length,deref_vector(stack[elements]));
+    stack_drop(1);
+}
+
+lisp_object sort_list(unsigned at,unsigned less,unsigned length) //Relinks the cells of the list at stack[at]
+{
+    std::vector<lisp_object> cells;
+    cells.reserve(length);
+    for(lisp_object lst = stack[at];!null(lst);lst = cdr(lst.id))
+        cells.push_back(lst);
+    if(!sort_fixnums(cells.data(),cells.data() + length,stack[less],true)) {
+        reserve_cells(vector_cells(length));
+        const unsigned id = allocate_vector(length);
+        lisp_object* element = deref_vector(make_obj(lisp_vector,id));
+        for(lisp_object lst = stack[at];!null(lst);lst = cdr(lst.id)) //Read again, reserve_cells may have collected
+            *(element++) = lst;
+        push(make_obj(lisp_vector,id));
+        sort_elements(stack_pointer - 1,less,true);
+        pop(val);
+        std::copy(deref_vector(val),deref_vector(val) + length,cells.begin());
+    }
+    for(unsigned i = 0;i + 1 < length;++i)
+        set_cdr(cells[i].id,cells[i + 1]);
+    set_cdr(cells[length - 1].id,nil);
+    return cells[0];
+}
+
+void sort_sequence(unsigned num,bool copy,const char* msg)
+{
+    if(num != 2)
+        throw SimpleError(msg);
+    const unsigned at = stack_pointer - 2, less = stack_pointer - 1;
+    if(typep(stack[at],lisp_vector)) {
+        if(copy) {
+            const unsigned length = vector_length(stack[at]);
+            reserve_cells(vector_cells(length));
+            const lisp_object vec = make_obj(lisp_vector,allocate_vector(length));
+            std::copy(deref_vector(stack[at]),deref_vector(stack[at]) + length,deref_vector(vec));
+            stack[at] = vec;
+        }
+        sort_elements(at,less,false);
+        val = stack[at];
+        return;
+    }
+    const unsigned length = list_length(stack[at],msg);
+    if(length < 2) {
+        val = stack[at];
+        return;
+    }
+    if(copy) {
+        reserve_cells(length);
+        lisp_object head = nil, tail = nil;
+        for(lisp_object lst = stack[at];!null(lst);lst = cdr(lst.id)) {
+            const lisp_object cell = reserved_cons(car(lst.id),nil);
+            if(null(head))
+                head = cell;
+            else
+                set_cdr(tail.id,cell);
+            tail = cell;
+        }
+        stack[at] = head;
+    }
+    val = sort_list(at,less,length);
+}
+
+//Primitives
+
+void prim_sort(unsigned num)
+{
+    sort_sequence(num,true,"sort: list or vector and predicate awaited");
+}
+
+void prim_sort_in_place(unsigned num)
+{
+    sort_sequence(num,false,"sort!: list or vector and predicate awaited");
+}
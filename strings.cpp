@@ -0,0 +1,79 @@
+//Strings
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "lisp.hpp"
+
+/*
+    substring copies, but for results of large_object_bytes and more: those are slices
+    sharing the bytes of the large string they come from (see allocate_large_slice).
+    string-byte-set! on either copies the bytes first, a write is never seen by the other.
+    For text built piece by piece, write-string to an output string port appends to a
+    growable buffer and get-output-string makes the string once.
+*/
+
+void prim_string_append(unsigned num)
+{
+    unsigned length = 0;
+    for(unsigned i = 0;i < num;++i) {
+        if(!typep(stack_get(i),lisp_string))
+            throw SimpleError("string-append: args must be strings");
+        length += vector_length(stack_get(i));
+    }
+    reserve_cells(string_cells(length));
+    const lisp_object res = make_obj(lisp_string,allocate_byte_vector(length));
+    byte_t* target = deref_string(res);
+    for(unsigned i = num;i > 0;--i) {
+        const lisp_object str = stack_get(i - 1);
+        memcpy(target,deref_string(str),vector_length(str));
+        target += vector_length(str);
+    }
+    val = res;
+}
+
+void prim_substring(unsigned num) //(substring string start [end])
+{
+    if((num != 2 && num != 3) || !typep(stack_get(num - 1),lisp_string))
+        throw SimpleError("substring: string, start and end awaited");
+    const lisp_object str = stack_get(num - 1);
+    const lisp_object start = stack_get(num - 2);
+    const lisp_object end = num == 3 ? stack_get(0) : number(vector_length(str));
+    if(!typep(start,fixnum) || !typep(end,fixnum) || start.id > end.id || end.id > vector_length(str))
+        throw SimpleError("substring: invalid range");
+    val = make_substring(str,start.id,end.id - start.id);
+}
+
+void prim_string_to_symbol(unsigned num)
+{
+    if(num != 1 || !typep(stack_get(0),lisp_string))
+        throw SimpleError("string->symbol: string awaited");
+    const std::string name(reinterpret_cast<char*>(deref_string(stack_get(0))),vector_length(stack_get(0)));
+    val = intern(name.c_str());
+}
+
+void prim_symbol_to_string(unsigned num)
+{
+    if(num != 1 || !typep(stack_get(0),symbol))
+        throw SimpleError("symbol->string: symbol awaited");
+    const char* name = get_symbol(stack_get(0).id);
+    val = make_string(strlen(name),name);
+}
+
+void prim_number_to_string(unsigned num)
+{
+    if(num != 1)
+        throw SimpleError("number->string: number awaited");
+    std::string text;
+    if(typep(stack_get(0),fixnum)) {
+        text = std::to_string(fixnum_value(stack_get(0)));
+#ifdef LISP_NAN_BOXING
+    } else if(typep(stack_get(0),double_float)) {
+        char buffer[32];
+        snprintf(buffer,sizeof(buffer),"%g",double_float_value(stack_get(0)));
+        text = buffer;
+#endif
+    } else {
+        throw SimpleError("number->string: number awaited");
+    }
+    val = make_string(text.size(),text.data());
+}
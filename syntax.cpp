@@ -0,0 +1,536 @@
+#include <unordered_map>
+#include <vector>
+#include <initializer_list>
+#include "lisp.hpp"
+
+//Derived forms and syntax-rules macros
+/*
+    A form is expanded when it is first evaluated, the expansion replaces it in place.
+    Later evaluations of the same code see core forms only.
+    Expanders reserve heap cells first, so no collection happens while raw objects are held.
+    They allocate with expansion_cons, which takes from that reservation and never collects:
+    an expansion larger than its estimate is an error, not a collection under C++ locals.
+
+    syntax-rules renames the identifiers a template binds (lambda parameters, let variables)
+    so they cannot capture the user's. Free identifiers of a template are not renamed: they
+    mean what they mean where the macro is used, so a local binding of the same name there
+    captures them. Templates should refer to globals the user does not shadow.
+*/
+
+thread_local unsigned expansion_cells = 0; //Left in the reservation of the running expansion
+
+void reserve_expansion(unsigned count) //Returns after collecting at most once
+{
+    reserve_cells(count);
+    expansion_cells = count;
+}
+
+lisp_object expansion_cons(lisp_object car,lisp_object cdr)
+{
+    if(expansion_cells == 0)
+        throw SimpleError("syntax: expansion larger than its reservation");
+    --expansion_cells;
+    return reserved_cons(car,cdr);
+}
+
+void syntax_check(bool valid,const char* msg)
+{
+    if(!valid)
+        throw SimpleError(msg);
+}
+
+lisp_object cadr(lisp_object lst)
+{
+    return car(cdr(lst.id).id);
+}
+
+lisp_object cddr(lisp_object lst)
+{
+    return cdr(cdr(lst.id).id);
+}
+
+bool pairp(lisp_object obj)
+{
+    return typep(obj,cons_cell);
+}
+
+unsigned tree_cells(lisp_object form)
+{
+    unsigned count = 0;
+    while(pairp(form)) {
+        count += 1 + tree_cells(car(form.id));
+        form = cdr(form.id);
+    }
+    return count;
+}
+
+unsigned list_cells(lisp_object lst)
+{
+    unsigned count = 0;
+    for(;pairp(lst);lst = cdr(lst.id))
+        ++count;
+    return count;
+}
+
+bool memberp(lisp_object sym,lisp_object lst)
+{
+    for(;pairp(lst);lst = cdr(lst.id))
+        if(eq(car(lst.id),sym))
+            return true;
+    return false;
+}
+
+lisp_object make_list(std::initializer_list<lisp_object> items,lisp_object tail = nil)
+{
+    for(auto item = items.end();item != items.begin();)
+        tail = expansion_cons(*--item,tail);
+    return tail;
+}
+
+lisp_object make_list(const std::vector<lisp_object>& items,lisp_object tail = nil)
+{
+    for(auto item = items.rbegin();item != items.rend();++item)
+        tail = expansion_cons(*item,tail);
+    return tail;
+}
+
+void replace_form(lisp_object form,lisp_object expansion) //Needs one free cell
+{
+    if(pairp(expansion)) {
+        set_car(form.id,car(expansion.id));
+        set_cdr(form.id,cdr(expansion.id));
+    } else {
+        set_car(form.id,sym_begin);
+        set_cdr(form.id,expansion_cons(expansion,nil));
+    }
+}
+
+//Derived forms
+
+void split_bindings(lisp_object bindings,std::vector<lisp_object>& vars,std::vector<lisp_object>& inits)
+{
+    for(;pairp(bindings);bindings = cdr(bindings.id)) {
+        lisp_object binding = car(bindings.id);
+        syntax_check(pairp(binding) && typep(car(binding.id),symbol),"let: bad binding");
+        vars.push_back(car(binding.id));
+        inits.push_back(pairp(cdr(binding.id)) ? cadr(binding) : nil);
+    }
+    syntax_check(null(bindings),"let: bad bindings");
+}
+
+lisp_object expand_let(lisp_object form) //Named let is bound by letrec
+{
+    lisp_object rest = cdr(form.id);
+    syntax_check(pairp(rest),"let: bad syntax");
+    lisp_object name = nil;
+    if(typep(car(rest.id),symbol)) {
+        name = car(rest.id);
+        rest = cdr(rest.id);
+        syntax_check(pairp(rest),"let: bad syntax");
+    }
+    syntax_check(pairp(cdr(rest.id)),"let: empty body");
+    std::vector<lisp_object> vars, inits;
+    split_bindings(car(rest.id),vars,inits);
+
+    lisp_object lambda = expansion_cons(sym_lambda,expansion_cons(make_list(vars),cdr(rest.id)));
+    if(!null(name))
+        lambda = make_list({sym_letrec,make_list({make_list({name,lambda})}),name});
+    return expansion_cons(lambda,make_list(inits));
+}
+
+lisp_object expand_let_star(lisp_object form)
+{
+    syntax_check(pairp(cdr(form.id)) && pairp(cddr(form)),"let*: bad syntax");
+    lisp_object bindings = cadr(form);
+    if(null(bindings) || (pairp(bindings) && null(cdr(bindings.id))))
+        return expansion_cons(sym_let,cdr(form.id));
+    syntax_check(pairp(bindings),"let*: bad bindings");
+    lisp_object inner = expansion_cons(sym_let_star,expansion_cons(cdr(bindings.id),cddr(form)));
+    return make_list({sym_let,make_list({car(bindings.id)}),inner});
+}
+
+lisp_object expand_letrec(lisp_object form) //Internal defines give letrec* semantics
+{
+    syntax_check(pairp(cdr(form.id)) && pairp(cddr(form)),"letrec: bad syntax");
+    std::vector<lisp_object> vars, inits, defines;
+    split_bindings(cadr(form),vars,inits);
+    for(size_t i = 0;i < vars.size();++i)
+        defines.push_back(make_list({sym_define,vars[i],inits[i]}));
+    return make_list({expansion_cons(sym_lambda,expansion_cons(nil,make_list(defines,cddr(form))))});
+}
+
+lisp_object expand_cond(lisp_object form)
+{
+    lisp_object clauses = cdr(form.id);
+    if(null(clauses))
+        return nil;
+    lisp_object clause = car(clauses.id);
+    syntax_check(pairp(clause),"cond: bad clause");
+    lisp_object rest = null(cdr(clauses.id)) ? nil : expansion_cons(sym_cond,cdr(clauses.id));
+    lisp_object test = car(clause.id);
+
+    if(eq(test,sym_else)) {
+        syntax_check(pairp(cdr(clause.id)),"cond: empty else clause"); //(begin) has no value
+        return expansion_cons(sym_begin,cdr(clause.id));
+    }
+    if(null(cdr(clause.id)))
+        return null(rest) ? test : make_list({sym_or,test,rest});
+    if(eq(cadr(clause),sym_arrow)) {
+        syntax_check(pairp(cddr(clause)),"cond: bad => clause");
+        lisp_object tmp = gensym("cond");
+        lisp_object call = make_list({car(cddr(clause).id),tmp});
+        return make_list({sym_let,make_list({make_list({tmp,test})}),make_list({sym_if,tmp,call,rest})});
+    }
+    return make_list({sym_if,test,expansion_cons(sym_begin,cdr(clause.id)),rest});
+}
+
+lisp_object expand_case(lisp_object form) //Keys are compared with the eq? primitive itself
+{
+    static const lisp_object prim_eq = find_primitive("eq?");
+    syntax_check(pairp(cdr(form.id)),"case: bad syntax");
+    lisp_object tmp = gensym("key");
+    std::vector<lisp_object> clauses;
+    for(lisp_object rest = cddr(form);pairp(rest);rest = cdr(rest.id))
+        clauses.push_back(car(rest.id));
+
+    lisp_object result = nil;
+    for(auto clause = clauses.rbegin();clause != clauses.rend();++clause) {
+        syntax_check(pairp(*clause) && pairp(cdr(clause->id)),"case: bad clause");
+        lisp_object branch = expansion_cons(sym_begin,cdr(clause->id));
+        if(eq(car(clause->id),sym_else)) {
+            result = branch;
+            continue;
+        }
+        std::vector<lisp_object> data;
+        for(lisp_object datum = car(clause->id);pairp(datum);datum = cdr(datum.id))
+            data.push_back(car(datum.id));
+        for(auto datum = data.rbegin();datum != data.rend();++datum)
+            result = make_list({sym_if,make_list({prim_eq,tmp,expansion_cons(sym_quote,*datum)}),branch,result});
+    }
+    return make_list({sym_let,make_list({make_list({tmp,cadr(form)})}),result});
+}
+
+lisp_object expand_and(lisp_object form)
+{
+    lisp_object args = cdr(form.id);
+    if(null(args))
+        return val_true;
+    if(null(cdr(args.id)))
+        return car(args.id);
+    return make_list({sym_if,car(args.id),expansion_cons(sym_and,cdr(args.id)),val_false});
+}
+
+lisp_object expand_or(lisp_object form)
+{
+    lisp_object args = cdr(form.id);
+    if(null(args))
+        return val_false;
+    if(null(cdr(args.id)))
+        return car(args.id);
+    lisp_object tmp = gensym("or");
+    return make_list({sym_let,make_list({make_list({tmp,car(args.id)})}),
+                      make_list({sym_if,tmp,tmp,expansion_cons(sym_or,cdr(args.id))})});
+}
+
+lisp_object expand_when(lisp_object form,bool when)
+{
+    syntax_check(pairp(cdr(form.id)) && pairp(cddr(form)),"when: bad syntax");
+    lisp_object body = expansion_cons(sym_begin,cddr(form));
+    return make_list({sym_if,cadr(form),when ? body : nil,when ? nil : body});
+}
+
+lisp_object expand_define_record_type(lisp_object form) //Procedures call the record primitives themselves
+{
+    static const lisp_object make_record = find_primitive("%make-record");
+    static const lisp_object recordp = find_primitive("%record?");
+    static const lisp_object record_ref = find_primitive("%record-ref");
+    static const lisp_object record_set = find_primitive("%record-set!");
+    static const lisp_object sym_record = make_symbol("record");
+    static const lisp_object sym_value = make_symbol("value");
+    syntax_check(list_cells(form) >= 4 && typep(cadr(form),symbol) && typep(cadr(cddr(form)),symbol),
+                 "define-record-type: bad syntax");
+    const lisp_object name = cadr(form);
+    const lisp_object constructor = car(cddr(form).id);
+    const lisp_object predicate = cadr(cddr(form));
+    std::vector<lisp_object> fields, specs;
+    for(lisp_object rest = cddr(cddr(form));pairp(rest);rest = cdr(rest.id)) {
+        const lisp_object spec = car(rest.id);
+        syntax_check(pairp(spec) && typep(car(spec.id),symbol) && pairp(cdr(spec.id)) && typep(cadr(spec),symbol),
+                     "define-record-type: bad field");
+        fields.push_back(car(spec.id));
+        specs.push_back(spec);
+    }
+
+    const lisp_object type = make_list({name},make_list(fields));
+    const lisp_object quoted = expansion_cons(sym_quote,type);
+    std::vector<lisp_object> definitions;
+    definitions.push_back(make_list({sym_define,name,quoted}));
+    if(!eq(constructor,val_false)) { //A bare name takes all fields
+        syntax_check(pairp(constructor) || typep(constructor,symbol),"define-record-type: bad constructor");
+        const lisp_object params = pairp(constructor) ? cdr(constructor.id) : make_list(fields);
+        std::vector<lisp_object> args = {make_record,quoted};
+        for(lisp_object field : fields)
+            args.push_back(memberp(field,params) ? field : val_false);
+        for(lisp_object param = params;pairp(param);param = cdr(param.id)) {
+            bool found = false;
+            for(lisp_object field : fields)
+                found = found || eq(field,car(param.id));
+            syntax_check(found,"define-record-type: constructor argument is not a field");
+        }
+        const lisp_object constructor_name = pairp(constructor) ? car(constructor.id) : constructor;
+        definitions.push_back(make_list({sym_define,constructor_name,make_list({sym_lambda,params,make_list(args)})}));
+    }
+    definitions.push_back(make_list({sym_define,predicate,
+                                     make_list({sym_lambda,make_list({sym_record}),make_list({recordp,sym_record,quoted})})}));
+    for(size_t i = 0;i < specs.size();++i) {
+        const lisp_object accessor = make_list({record_ref,sym_record,quoted,number(static_cast<unsigned>(i))});
+        definitions.push_back(make_list({sym_define,cadr(specs[i]),make_list({sym_lambda,make_list({sym_record}),accessor})}));
+        if(!pairp(cddr(specs[i])))
+            continue;
+        const lisp_object modifier = make_list({record_set,sym_record,quoted,number(static_cast<unsigned>(i)),sym_value});
+        definitions.push_back(make_list({sym_define,car(cddr(specs[i]).id),
+                                         make_list({sym_lambda,make_list({sym_record,sym_value}),modifier})}));
+    }
+    return expansion_cons(sym_begin,make_list(definitions));
+}
+
+bool derivedp(lisp_object expr)
+{
+    const lisp_object head = car(expr.id);
+    return typep(head,symbol) &&
+           (eq(head,sym_let) || eq(head,sym_let_star) || eq(head,sym_letrec) || eq(head,sym_letrec_star) ||
+            eq(head,sym_cond) || eq(head,sym_case) || eq(head,sym_and) || eq(head,sym_or) ||
+            eq(head,sym_when) || eq(head,sym_unless) || eq(head,sym_define_record_type));
+}
+
+void expand_derived(void) //expr is the form
+{
+    reserve_expansion(16*tree_cells(expr) + 64); //Record types take most per source cell
+    const lisp_object head = car(expr.id);
+    lisp_object expansion = nil;
+    if(eq(head,sym_let)) {
+        expansion = expand_let(expr);
+    } else if(eq(head,sym_let_star)) {
+        expansion = expand_let_star(expr);
+    } else if(eq(head,sym_letrec) || eq(head,sym_letrec_star)) {
+        expansion = expand_letrec(expr);
+    } else if(eq(head,sym_cond)) {
+        expansion = expand_cond(expr);
+    } else if(eq(head,sym_case)) {
+        expansion = expand_case(expr);
+    } else if(eq(head,sym_and)) {
+        expansion = expand_and(expr);
+    } else if(eq(head,sym_or)) {
+        expansion = expand_or(expr);
+    } else if(eq(head,sym_define_record_type)) {
+        expansion = expand_define_record_type(expr);
+    } else {
+        expansion = expand_when(expr,eq(head,sym_when));
+    }
+    replace_form(expr,expansion);
+}
+
+//syntax-rules
+
+struct syntax_binding
+{
+    lisp_object value;
+    bool sequence; //Bound under an ellipsis, items hold the matches
+    std::vector<syntax_binding> items;
+};
+
+using syntax_bindings = std::unordered_map<unsigned,syntax_binding>;
+
+struct syntax_context
+{
+    std::unordered_map<unsigned,lisp_object> renames; //Identifiers the template binds
+    bool counting; //Only count cells, nothing is allocated
+    unsigned cells;
+};
+
+bool literalp(lisp_object sym,lisp_object literals)
+{
+    for(;pairp(literals);literals = cdr(literals.id))
+        if(eq(car(literals.id),sym))
+            return true;
+    return false;
+}
+
+bool ellipsis_follows(lisp_object pattern)
+{
+    return pairp(cdr(pattern.id)) && eq(cadr(pattern),sym_ellipsis);
+}
+
+void pattern_vars(lisp_object pattern,lisp_object literals,std::vector<unsigned>& vars)
+{
+    if(typep(pattern,symbol)) {
+        if(!eq(pattern,sym_ellipsis) && !eq(pattern,sym_underscore) && !literalp(pattern,literals))
+            vars.push_back(pattern.id);
+    } else if(pairp(pattern)) {
+        pattern_vars(car(pattern.id),literals,vars);
+        pattern_vars(cdr(pattern.id),literals,vars);
+    }
+}
+
+bool match(lisp_object pattern,lisp_object form,lisp_object literals,syntax_bindings& bindings)
+{
+    if(typep(pattern,symbol)) {
+        if(eq(pattern,sym_underscore))
+            return true;
+        if(literalp(pattern,literals))
+            return eq(pattern,form);
+        bindings[pattern.id] = syntax_binding{form,false,{}};
+        return true;
+    }
+    if(!pairp(pattern))
+        return eq(pattern,form);
+
+    if(ellipsis_follows(pattern)) {
+        const lisp_object after = cddr(pattern);
+        const unsigned available = list_cells(form), needed = list_cells(after);
+        if(available < needed)
+            return false;
+        std::vector<unsigned> vars;
+        pattern_vars(car(pattern.id),literals,vars);
+        for(unsigned var : vars)
+            bindings[var] = syntax_binding{nil,true,{}};
+        for(unsigned i = 0;i < available - needed;++i,form = cdr(form.id)) {
+            syntax_bindings item;
+            if(!match(car(pattern.id),car(form.id),literals,item))
+                return false;
+            for(unsigned var : vars)
+                bindings[var].items.push_back(item[var]);
+        }
+        return match(after,form,literals,bindings);
+    }
+    return pairp(form) && match(car(pattern.id),car(form.id),literals,bindings) &&
+           match(cdr(pattern.id),cdr(form.id),literals,bindings);
+}
+
+void rename_binder(lisp_object sym,const syntax_bindings& bindings,syntax_context& context)
+{
+    if(typep(sym,symbol) && !bindings.count(sym.id) && !eq(sym,sym_ellipsis) &&
+       !eq(sym,sym_underscore) && !context.renames.count(sym.id))
+        context.renames[sym.id] = gensym(get_symbol(sym.id));
+}
+
+void template_binders(lisp_object tmpl,const syntax_bindings& bindings,syntax_context& context)
+{
+    if(!pairp(tmpl))
+        return;
+    const lisp_object head = car(tmpl.id);
+    if(eq(head,sym_lambda) && pairp(cdr(tmpl.id))) {
+        lisp_object params = cadr(tmpl);
+        for(;pairp(params);params = cdr(params.id))
+            rename_binder(car(params.id),bindings,context);
+        rename_binder(params,bindings,context); //Rest parameter
+    } else if((eq(head,sym_let) || eq(head,sym_let_star) || eq(head,sym_letrec) || eq(head,sym_letrec_star))
+              && pairp(cdr(tmpl.id))) {
+        lisp_object rest = cdr(tmpl.id);
+        if(typep(car(rest.id),symbol)) {
+            rename_binder(car(rest.id),bindings,context);
+            rest = cdr(rest.id);
+        }
+        for(lisp_object binding = pairp(rest) ? car(rest.id) : nil;pairp(binding);binding = cdr(binding.id))
+            rename_binder(pairp(car(binding.id)) ? car(car(binding.id).id) : car(binding.id),bindings,context);
+    }
+    for(;pairp(tmpl);tmpl = cdr(tmpl.id))
+        template_binders(car(tmpl.id),bindings,context);
+}
+
+lisp_object make_cell(syntax_context& context,lisp_object car,lisp_object cdr)
+{
+    ++context.cells;
+    return context.counting ? nil : expansion_cons(car,cdr);
+}
+
+void sequence_vars(lisp_object tmpl,const syntax_bindings& bindings,std::vector<unsigned>& vars)
+{
+    if(typep(tmpl,symbol)) {
+        auto binding = bindings.find(tmpl.id);
+        if(binding != bindings.end() && binding->second.sequence)
+            vars.push_back(tmpl.id);
+    } else if(pairp(tmpl)) {
+        sequence_vars(car(tmpl.id),bindings,vars);
+        sequence_vars(cdr(tmpl.id),bindings,vars);
+    }
+}
+
+lisp_object instantiate(lisp_object tmpl,const syntax_bindings& bindings,syntax_context& context)
+{
+    if(typep(tmpl,symbol)) {
+        auto binding = bindings.find(tmpl.id);
+        if(binding != bindings.end()) {
+            syntax_check(!binding->second.sequence,"syntax-rules: pattern variable needs an ellipsis");
+            return binding->second.value;
+        }
+        auto renamed = context.renames.find(tmpl.id);
+        return renamed != context.renames.end() ? renamed->second : tmpl;
+    }
+    if(!pairp(tmpl))
+        return tmpl;
+    if(eq(car(tmpl.id),sym_ellipsis) && pairp(cdr(tmpl.id))) //(... template) is literal
+        return cadr(tmpl);
+
+    if(ellipsis_follows(tmpl)) {
+        std::vector<unsigned> vars;
+        sequence_vars(car(tmpl.id),bindings,vars);
+        syntax_check(!vars.empty(),"syntax-rules: ellipsis without pattern variable");
+        const size_t count = bindings.at(vars[0]).items.size();
+        for(unsigned var : vars)
+            syntax_check(bindings.at(var).items.size() == count,"syntax-rules: ellipsis lengths differ");
+
+        std::vector<lisp_object> items;
+        for(size_t i = 0;i < count;++i) {
+            syntax_bindings iteration = bindings;
+            for(unsigned var : vars)
+                iteration[var] = bindings.at(var).items[i];
+            items.push_back(instantiate(car(tmpl.id),iteration,context));
+        }
+        lisp_object tail = instantiate(cddr(tmpl),bindings,context);
+        for(auto item = items.rbegin();item != items.rend();++item)
+            tail = make_cell(context,*item,tail);
+        return tail;
+    }
+    lisp_object head = instantiate(car(tmpl.id),bindings,context);
+    lisp_object tail = instantiate(cdr(tmpl.id),bindings,context);
+    return make_cell(context,head,tail);
+}
+
+void eval_define_syntax(void) //(define-syntax name (syntax-rules (literals) (pattern template) ...))
+{
+    syntax_check(pairp(cdr(expr.id)) && typep(cadr(expr),symbol) && pairp(cddr(expr)),"define-syntax: bad syntax");
+    const lisp_object spec = car(cddr(expr).id);
+    syntax_check(pairp(spec) && eq(car(spec.id),sym_syntax_rules) && pairp(cdr(spec.id)),"define-syntax: syntax-rules awaited");
+    for(lisp_object rule = cddr(spec);pairp(rule);rule = cdr(rule.id))
+        syntax_check(pairp(car(rule.id)) && pairp(car(car(rule.id).id)) && pairp(cdr(car(rule.id).id)),"syntax-rules: bad rule");
+
+    val = make_obj(macro,cons(cadr(spec),cddr(spec)).id); //(literals . rules)
+    extend_environment(cadr(expr),val);
+}
+
+void expand_macro_use(void) //expr is the form, val the macro
+{
+    bool collected = false;
+    do {
+        const lisp_object literals = car(val.id);
+        lisp_object rule = cdr(val.id);
+        syntax_bindings bindings;
+        while(!null(rule) && !match(cdr(car(car(rule.id).id).id),cdr(expr.id),literals,bindings)) {
+            bindings.clear();
+            rule = cdr(rule.id);
+        }
+        syntax_check(!null(rule),"syntax-rules: no pattern matches");
+
+        const lisp_object tmpl = cadr(car(rule.id));
+        syntax_context context{{},true,0};
+        template_binders(tmpl,bindings,context);
+        instantiate(tmpl,bindings,context);
+        collected = reserve_cells(context.cells + 1); //Registers are traced, so the match is redone
+        if(!collected) {
+            expansion_cells = context.cells + 1;
+            context.counting = false;
+            replace_form(expr,instantiate(tmpl,bindings,context));
+        }
+    } while(collected);
+}
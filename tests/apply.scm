@@ -0,0 +1,33 @@
+(define (f a . rest) (list a rest))
+(f 1)
+(f 1 2 3)
+(define (g . all) all)
+(g)
+(g 1 2)
+((lambda args args) 'x 'y)
+((lambda (a b . c) (list a b c)) 1 2 3 4)
+(define (ignores a . rest) a)
+(ignores 7 8 9)
+(f)
+((lambda (a b . c) a) 1)
+(apply + '(1 2 3))
+(apply + 1 2 '(3 4))
+(apply list '())
+(apply f 1 '(2 3))
+(apply g '(a b c))
+(apply (lambda (x y) (* x y)) '(6 7))
+(apply car '((1 2)))
+(apply + 1 2)
+(apply 5 '(1))
+(apply +)
+(define (kept . rest) (lambda () rest))
+(define k (kept 1 2 3))
+(gc)
+(k)
+(define (sum . nums) (fold-left + 0 nums))
+(apply sum (list 1 2 3 4 5 6 7 8 9 10))
+(define (count-args . args) (length args))
+(define (build k acc) (if (= k 0) acc (build (- k 1) (cons k acc))))
+(apply count-args (build 500 '()))
+(define (set-rest . r) (set! r (cons 0 r)) r)
+(set-rest 1 2)
@@ -0,0 +1,21 @@
+(call/cc (lambda (k) (+ 1 (k 42))))
+(call/cc (lambda (k) 5))
+(define (first-over n lst)
+  (call/cc (lambda (return) (for-each (lambda (x) (if (> x n) (return x) #f)) lst) #f)))
+(first-over 3 (list 1 2 3 4 5))
+(first-over 9 (list 1 2 3 4 5))
+(define saved #f)
+(call/cc (lambda (k) (set! saved k) 1))
+(saved 3)
+(define trace '())
+(define (note x) (set! trace (cons x trace)))
+(call/cc (lambda (k) (dynamic-wind (lambda () (note 'in)) (lambda () (k 'out) (note 'never)) (lambda () (note 'after)))))
+trace
+(dynamic-wind (lambda () (note 'before)) (lambda () (car 1)) (lambda () (note 'cleanup)))
+trace
+(call/cc (lambda (outer) (call/cc (lambda (inner) (outer 'outer))) 'inner))
+(define (deep n k) (if (= n 0) (k 'bottom) (+ 1 (deep (- n 1) k))))
+(call/cc (lambda (k) (deep 100 k)))
+(call/cc (lambda (k) (k 1 2)))
+(call/cc (lambda (k) (join (spawn (lambda () (k 1))))))
+(map (lambda (x) (call/cc (lambda (k) (if (= x 2) (k 'two) x)))) (list 1 2 3))
@@ -0,0 +1,31 @@
+(define (make-counter) (let ((n 0)) (cons (lambda () (set! n (+ n 1)) n) (lambda () n))))
+(define c (make-counter))
+((car c))
+((car c))
+((cdr c))
+(define c2 (make-counter))
+((car c2))
+(list ((cdr c)) ((cdr c2)))
+(define (make-account balance) (list (lambda (x) (set! balance (+ balance x)) balance) (lambda (x) (set! balance (- balance x)) balance) (lambda () balance)))
+(define acc (make-account 100))
+((car acc) 50)
+((car (cdr acc)) 30)
+(gc)
+((car (cdr (cdr acc))))
+(define (adder k) (lambda (x) (+ x k)))
+(map (adder 10) (list 1 2 3))
+(define (nest a) (lambda (b) (lambda (c) (list a b c))))
+(((nest 1) 2) 3)
+(define (shadow x) (let ((f (lambda () x))) (set! x 'changed) (f)))
+(shadow 'original)
+(define (loop-closures k acc) (if (= k 0) acc (loop-closures (- k 1) (cons (lambda () k) acc))))
+(map (lambda (f) (f)) (loop-closures 5 '()))
+(define g 1)
+(define (read-g) g)
+(set! g 2)
+(read-g)
+(define (param-set x) (set! x (* x 2)) x)
+(param-set 21)
+(define (many k) (if (= k 0) 'done (begin (make-counter) (many (- k 1)))))
+(many 5000)
+((car c))
@@ -0,0 +1,83 @@
+//Embedding API checks, run by tests/run.sh
+#include <cstdio>
+#include "embed.hpp"
+
+unsigned failures = 0;
+
+void check(bool ok,const char* what)
+{
+    if(!ok) {
+        printf("embed_test: %s failed\n",what);
+        ++failures;
+    }
+}
+
+bool number_is(const lisp_handle& result,long long expected)
+{
+    return typep(result.get(),fixnum) && fixnum_value(result.get()) == expected;
+}
+
+void prim_square(unsigned)
+{
+    const long long x = fixnum_value(stack_get(0));
+    val = number(static_cast<int>(x*x));
+}
+
+int main()
+{
+    lisp_interpreter lisp;
+    lisp.define_primitive("square",prim_square,1,1);
+
+    check(number_is(lisp.eval("(+ 1 2)"),3),"eval");
+    check(number_is(lisp.eval("(define a 1)(+ a 41)"),42),"eval of adjacent forms");
+    check(number_is(lisp.eval("(define b 2);comment\n(+ a b);comment"),3),"eval with comments");
+    check(number_is(lisp.eval("(define (f x) (square x)) (f 12)"),144),"define_primitive");
+
+    lisp_handle f = lisp.eval("f");
+    check(number_is(lisp.call(f,{lisp_handle(number(5))}),25),"call");
+
+    lisp.define("answer",lisp_handle(number(42)));
+    check(number_is(lisp.eval("answer"),42),"define");
+
+    bool thrown = false;
+    try {
+        lisp.eval("(car 1)");
+    } catch(SimpleError&) {
+        thrown = true;
+    }
+    check(thrown,"error");
+    check(number_is(lisp.eval("(f 3)"),9),"eval after an error");
+
+    evaluation_limits limits;
+    limits.steps = 10000;
+    lisp.set_limits(limits);
+    thrown = false;
+    try {
+        lisp.eval("(define (loop) (loop)) (loop)");
+    } catch(interruption&) {
+        thrown = true;
+    }
+    check(thrown,"step limit");
+    lisp.set_limits(evaluation_limits());
+    check(number_is(lisp.eval("(f 4)"),16),"eval after an interruption");
+
+    lisp_handle kept = lisp.eval("(list 1 2 (list 3 4) \"five\")");
+    lisp_handle adder = lisp.eval("(define (make-adder k) (lambda (x) (+ x k))) (make-adder 10)");
+    const lisp_object before = kept.get();
+    lisp.eval("(define (churn n) (if (= n 0) 0 (begin (make-vector 100000 0) (cons n n) (churn (- n 1))))) (churn 400)");
+    check(kept.get().id != before.id,"collection while handles are held");
+    check(number_is(lisp.call(lisp.eval("length"),{kept}),4),"handle after a collection");
+    check(number_is(lisp.call(lisp.eval("(lambda (l) (car (cdr (car (cdr (cdr l))))))"),{kept}),4),"nested list after a collection");
+    check(number_is(lisp.call(adder,{lisp_handle(number(32))}),42),"closure after a collection");
+
+    thrown = false;
+    try {
+        lisp_interpreter second;
+    } catch(SimpleError&) {
+        thrown = true;
+    }
+    check(thrown,"second interpreter");
+    check(number_is(lisp.eval("answer"),42),"state kept after a second interpreter");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+(define-syntax quiet (syntax-rules () ((_ e) (begin e 'ok))))
+(list (eqv? 1 1) (eqv? 'a 'a) (eqv? "a" "a") (eqv? '(1) '(1)))
+(list (equal? '(1 (2 "x") #t) '(1 (2 "x") #t)) (equal? '(1 2) '(1 3)) (equal? "abc" "abd") (equal? "ab" "abc"))
+(define v1 (make-vector 3 '(a b)))
+(define v2 (make-vector 3 '(a b)))
+(list (equal? v1 v2) (eqv? v1 v2) (eqv? v1 v1))
+(vector-set! v2 2 "other")
+(equal? v1 v2)
+(list (equal? '(1 . 2) '(1 . 2)) (equal? '() '()) (equal? 1 "1"))
+(= (equal-hash '(1 (2 "x"))) (equal-hash (list 1 (list 2 "x"))))
+(= (equal-hash "hello") (equal-hash (string-append "hel" "lo")))
+(= (equal-hash v1) (equal-hash (make-vector 3 '(a b))))
+(define (build k acc) (if (= k 0) acc (build (- k 1) (cons k acc))))
+(define deep-holder (make-vector 2 0))
+(define (nest k acc) (if (= k 0) acc (nest (- k 1) (list acc))))
+(quiet (vector-set! deep-holder 0 (nest 50000 'x)))
+(quiet (vector-set! deep-holder 1 (nest 50000 'x)))
+(equal? (vector-ref deep-holder 0) (vector-ref deep-holder 1))
+(= (equal-hash (vector-ref deep-holder 0)) (equal-hash (vector-ref deep-holder 1)))
+(equal? (build 20000 '()) (build 20000 '()))
+(equal? (build 20000 '()) (build 19999 '()))
+(quiet (define big1 (make-byte-string 20000 7)))
+(quiet (define big2 (make-byte-string 20000 7)))
+(equal? big1 big2)
+(string-byte-set! big2 19999 8)
+(equal? big1 big2)
+(member (list 2) (list (list 1) (list 2)))
+(assoc "k" (list (cons "j" 1) (cons "k" 2)))
+(equal?)
+(equal-hash)
@@ -0,0 +1,12 @@
+(load-extension "./extension_test.so")
+(byte-sum "abc")
+(define s (make-byte-string 4 65))
+(fill-bytes! s 66)
+s
+(fill-bytes! s 256)
+(byte-sum 5)
+(byte-sum "a" "b")
+(load-extension "./missing.so")
+(make-byte-string (- 0 1))
+(make-byte-string 3 (- 0 1))
+(string-byte-ref s (- 0 1))
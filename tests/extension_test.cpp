@@ -0,0 +1,28 @@
+//Shared object for tests/extension.scm, built by tests/run.sh
+#include "extension.hpp"
+
+void prim_byte_sum(unsigned num) //(byte-sum string)
+{
+    unsigned length = 0;
+    const byte_t* bytes = string_bytes(stack_get(0),length);
+    unsigned sum = 0;
+    for(unsigned i = 0;i < length;++i)
+        sum += bytes[i];
+    val = number(sum);
+}
+
+void prim_fill_bytes(unsigned num) //(fill-bytes! string byte) in place
+{
+    if(!typep(stack_get(0),fixnum) || stack_get(0).id > 255)
+        throw SimpleError("fill-bytes!: string and byte awaited");
+    unsigned length = 0;
+    byte_t* bytes = string_bytes(stack_get(1),length);
+    for(unsigned i = 0;i < length;++i)
+        bytes[i] = stack_get(0).id;
+    val = stack_get(1);
+}
+
+extern "C" const lisp_extension_primitive lisp_extension_primitives[] =
+    {{"byte-sum",prim_byte_sum,1,1},
+     {"fill-bytes!",prim_fill_bytes,2,2},
+     {nullptr,nullptr,0,0}};
@@ -0,0 +1,31 @@
+(define (sum-list l) (if (null? l) 0 (+ (car l) (sum-list (cdr l)))))
+(define (build k acc) (if (= k 0) acc (build (- k 1) (cons k acc))))
+(define nums (build 200 '()))
+(length nums)
+(sum-list nums)
+(define (deep k) (if (= k 0) 0 (+ 1 (deep (- k 1)))))
+(deep 200)
+(define (alloc-in-frame a b) (let ((v (make-vector 100 a))) (gc) (list a b (vector-ref v 99))))
+(alloc-in-frame (list 1 2) "kept")
+(define (fails x) (car x))
+(define (call-fails k) (if (= k 0) (fails 5) (+ 1 (call-fails (- k 1)))))
+(call-fails 100)
+(deep 100)
+(define (escapes x) (lambda () x))
+((escapes 'captured))
+(define (delayed x) (delay (* x 2)))
+(force (delayed 21))
+(define (inner-define x) (define y (* x 3)) (lambda () y))
+((inner-define 5))
+(define (via-callcc x) (+ 1 (call/cc (lambda (k) (k (* x 10))))))
+(via-callcc 4)
+(define (exit-early l) (call/cc (lambda (return) (for-each (lambda (x) (if (= x 3) (return 'found))) l) 'none)))
+(exit-early nums)
+(define (keep-args a b) (list a b))
+(define kept (keep-args (list 'x) (make-vector 1 'y)))
+(gc)
+(list (car kept) (vector-ref (car (cdr kept)) 0))
+(define (swap-args a b) (set! a b) a)
+(swap-args 1 2)
+(define (over-many k) (if (= k 0) 'done (begin (alloc-in-frame k k) (over-many (- k 1)))))
+(over-many 20)
@@ -0,0 +1,16 @@
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define f (future (lambda () (fib 20))))
+f
+(touch f)
+(touch f)
+(define bad (future (lambda () (car 1))))
+(touch bad)
+(touch bad)
+(define (spawn-all n acc) (if (= n 0) acc (spawn-all (- n 1) (cons (future (lambda () n)) acc))))
+(define (touch-all fs acc) (if (null? fs) acc (touch-all (cdr fs) (+ acc (touch (car fs))))))
+(touch-all (spawn-all 500 '()) 0)
+(touch-all (spawn-all 500 '()) 0)
+(parallel-map (lambda (x) (touch x)) (list f))
+(define g (future (lambda () 7)))
+(parallel-map (lambda (x) (touch x)) (list g))
+(touch g)
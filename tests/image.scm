@@ -0,0 +1,8 @@
+(define (square x) (* x x))
+(define table (list (cons 'a 1) (cons 'b "two") (make-vector 3 7)))
+(define big (make-vector 5000 1))
+(define counter (let ((n 0)) (lambda () (set! n (+ n 1)) n)))
+(counter)
+(define-syntax swap! (syntax-rules () ((_ a b) (let ((tmp a)) (set! a b) (set! b tmp)))))
+(save-image "image.img")
+(save-image 5)
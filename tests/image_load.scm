@@ -0,0 +1,13 @@
+(square 12)
+table
+(vector-length big)
+(vector-ref big 4999)
+(counter)
+(define p 1)
+(define q 2)
+(swap! p q)
+(list p q)
+(define (churn n) (if (= n 0) 'churned (begin (make-vector 1000 n) (churn (- n 1)))))
+(churn 300)
+(gc)
+(list (square 3) (vector-ref big 0) (counter))
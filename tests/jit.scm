@@ -0,0 +1,27 @@
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (tak x y z) (if (not-less y x) z (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))
+(define (not-less a b) (if (< a b) #f #t))
+(define (count-up i n acc) (if (= i n) acc (let ((next (+ i 1)) (sq (* i i))) (count-up next n (cons sq acc)))))
+(define (shadow x) (let ((x (+ x 1))) (let ((x (* x 2)) (y x)) (list x y))))
+(define (bump x) (let ((y 1)) (set! x (+ x y)) (set! y 10) (+ x y)))
+(define (make-adder k) (lambda (x) (let ((y (+ x k))) y)))
+(define add5 (make-adder 5))
+(define (len lst n) (if (null? lst) n (len (cdr lst) (+ n 1))))
+(define (mixed a) (+ a (car (list 1 2))))
+(define (outer n) (if (= n 0) 0 (let ((f (lambda (x) (+ x 1)))) (f (outer (- n 1))))))
+(define (tag n) (if (= n 0) 'done (tag (- n 1))))
+(define (bad-arity x) (let ((y x)) (car y)))
+(define (programs)
+  (list (fib 15) (tak 12 8 4) (len (count-up 0 300 '()) 0) (car (count-up 0 10 '()))
+        (shadow 3) (bump 4) (add5 37) (add5 (add5 1)) (mixed 41) (outer 50) (tag 10) '(quoted list)))
+(jit-threshold 1)
+(define compiled (list (programs) (programs)))
+compiled
+(len (count-up 0 200000 '()) 0)
+(bad-arity 5)
+(jit-threshold 0)
+(define interpreted (list (programs) (programs)))
+(equal? compiled interpreted)
+(bad-arity 5)
+(jit-threshold 50)
+(join (spawn (lambda () (tag 200000))))
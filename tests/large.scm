@@ -0,0 +1,21 @@
+(define big (make-vector 5000 0))
+(vector-length big)
+(vector-set! big 4999 (list 1 2 3))
+(vector-set! big 0 "young string")
+(define (fill v k) (if (= k 4000) v (begin (vector-set! v k (cons k k)) (fill v (+ k 1)))))
+(fill big 3000)
+(gc)
+(list (vector-ref big 4999) (vector-ref big 0) (vector-ref big 3500))
+(define (churn n) (if (= n 0) 'churned (begin (make-vector 3000 n) (churn (- n 1)))))
+(churn 500)
+(gc)
+(list (vector-ref big 4999) (vector-ref big 3999) (vector-length big))
+(define sv (make-vector 1 (make-byte-string 10000 65)))
+(string-byte-set! (vector-ref sv 0) 9999 66)
+(gc)
+(list (string-byte-ref (vector-ref sv 0) 0) (string-byte-ref (vector-ref sv 0) 9999))
+(define keep (list (make-vector 3000 'a) (make-vector 3000 'b)))
+(churn 200)
+(gc)
+(list (vector-ref (car keep) 2999) (vector-ref (car (cdr keep)) 0))
+(make-vector 0)
@@ -0,0 +1,10 @@
+(define (alloc n acc) (if (= n 0) acc (alloc (- n 1) (cons n acc))))
+(define (churn x) (churn (cons x x)))
+(length (alloc 1000 '()))
+(length (alloc 8000000 '()))
+(churn 1)
+(define t (spawn (lambda () (churn 2))))
+(join t)
+(length (alloc 40000 '()))
+(length (alloc 40000 '()))
+(+ 1 2)
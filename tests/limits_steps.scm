@@ -0,0 +1,11 @@
+(define (spin n) (if (eq? n 'stop) 'never (spin n)))
+(define (alloc n acc) (if (= n 0) acc (alloc (- n 1) (cons n acc))))
+(spin 1)
+(length (alloc 1000 '()))
+(length (alloc 8000000 '()))
+(define t (spawn (lambda () (spin 1))))
+(join t)
+(join t)
+(define c (make-channel))
+(channel-receive c)
+(+ 1 2)
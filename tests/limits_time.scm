@@ -0,0 +1,10 @@
+(define (spin n) (if (eq? n 'stop) 'never (spin n)))
+(spin 1)
+(define t (spawn (lambda () (spin 1))))
+(join t)
+(define (wait-forever) (channel-receive (make-channel)))
+(define waiter (spawn wait-forever))
+(define spinner (spawn (lambda () (spin 2))))
+(join waiter)
+(join spinner)
+(+ 1 2)
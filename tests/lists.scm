@@ -0,0 +1,36 @@
+(append '(1 2) '(3) '() '(4 5))
+(append)
+(append '(1) 2)
+(reverse '(1 2 3 4))
+(reverse '())
+(map (lambda (x) (* x x)) '(1 2 3))
+(map + '(1 2 3) '(10 20 30))
+(map car '())
+(define seen '())
+(for-each (lambda (x) (set! seen (cons x seen))) '(a b c))
+seen
+(filter (lambda (x) (> x 2)) '(1 5 2 4 3))
+(fold-left (lambda (acc x) (cons x acc)) '() '(1 2 3))
+(fold-right cons '() '(1 2 3))
+(fold-right - 0 '(1 2 3))
+(assq 'b '((a . 1) (b . 2)))
+(assq 'z '((a . 1)))
+(assoc "b" '(("a" . 1) ("b" . 2)))
+(assoc '(1 2) '(((1 2) . found)))
+(memq 'c '(a b c d))
+(member "c" '("a" "c" "d"))
+(member '(1) '(0 (1) 2))
+(list-tail '(1 2 3 4) 2)
+(list-ref '(a b c) 1)
+(list-ref '(a b c) 3)
+(list-tail '(1 2) 3)
+(map car '(1 2))
+(filter 5 '(1 2))
+(reverse '(1 2 . 3))
+(define (build k acc) (if (= k 0) acc (build (- k 1) (cons k acc))))
+(define holder (make-vector 1 (map (lambda (x) (* 2 x)) (build 20000 '()))))
+(define (big) (vector-ref holder 0))
+(length (big))
+(gc)
+(list (list-ref (big) 0) (list-ref (big) 19999) (length (reverse (big))) (length (append (big) (big))))
+(fold-left + 0 (filter (lambda (x) (< x 100)) (big)))
@@ -0,0 +1,14 @@
+(load "forms.scm")
+loaded
+(sum-to 100 0)
+(load "forms.scm")
+(square 12)
+(load "missing.scm")
+(load "adjacent.scm")
+(list a b c d e)
+(f c)
+(define x 5)(+ x 1);comment
+x
+(load "unbalanced.scm")
+)
+x
@@ -0,0 +1,4 @@
+(define a 1)(define b 2)(define c (+ a b));c is 3
+(define d 'sym)(define e "str");comment after a form
+d;no space before the comment
+(define (f x) (* x 10))'quoted(f c)
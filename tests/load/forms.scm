@@ -0,0 +1,4 @@
+(define (square x) (* x x))
+(define loaded (square 7))
+(define (sum-to n acc)
+  (if (= n 0) acc (sum-to (- n 1) (+ acc n))))
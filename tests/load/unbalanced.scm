@@ -0,0 +1,2 @@
+(define y 7))
+(define z 8)
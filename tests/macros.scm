@@ -0,0 +1,40 @@
+(let ((a 1) (b 2)) (+ a b))
+(let loop ((i 0) (acc 0)) (if (= i 10) acc (loop (+ i 1) (+ acc i))))
+(let* ((a 2) (b (* a 3))) (list a b))
+(letrec ((ev? (lambda (n) (if (= n 0) #t (od? (- n 1))))) (od? (lambda (n) (if (= n 0) #f (ev? (- n 1)))))) (ev? 100))
+(define (classify n) (cond ((< n 0) 'negative) ((= n 0) 'zero) (else 'positive)))
+(list (classify (- 0 5)) (classify 0) (classify 5))
+(cond ((assq 'b '((a 1) (b 2))) => (lambda (p) (car (cdr p)))) (else 'none))
+(define (kind x) (case x ((1 2 3) 'small) ((a b) 'letter) (else 'other)))
+(list (kind 2) (kind 'b) (kind 9))
+(list (and) (and 1 2) (and 1 #f 3) (or) (or #f 4) (or #f #f))
+(when (= 1 1) 'yes)
+(unless (= 1 2) 'no)
+(define-syntax swap! (syntax-rules () ((_ a b) (let ((tmp a)) (set! a b) (set! b tmp)))))
+(define tmp 1)
+(define other 2)
+(swap! tmp other)
+(list tmp other)
+(define-syntax my-or (syntax-rules () ((_) #f) ((_ e) e) ((_ e r ...) (let ((t e)) (if t t (my-or r ...))))))
+(define t 5)
+(my-or #f t)
+(define-syntax my-list (syntax-rules () ((_ (a b) ...) (list (cons a b) ...))))
+(my-list (1 2) (3 4) (5 6))
+(define-syntax is-else (syntax-rules (else) ((_ else) 'else) ((_ x) 'other)))
+(list (is-else else) (is-else 3))
+(define-syntax twice (syntax-rules () ((_ e) (begin e e))))
+(define n 0)
+(twice (set! n (+ n 1)))
+n
+(define-syntax add-one (syntax-rules () ((_ x) (+ x 1))))
+(let ((+ -)) (add-one 5))
+(define (expand-many k) (if (= k 0) 'expanded (begin (let ((v (make-vector 200 k))) (cond ((= k 1) v) (else k))) (expand-many (- k 1)))))
+(expand-many 300)
+(define-record-type point (make-point x y z w) point? (x point-x set-point-x!) (y point-y) (z point-z) (w point-w set-point-w!))
+(list (point-w (make-point 1 2 3 4)) (point? 5))
+(define-syntax broken (syntax-rules () ((_ a) a)))
+(broken)
+(let 5)
+(cond (else))
+(case 1 ((1)))
+(+ 1 2)
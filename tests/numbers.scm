@@ -0,0 +1,8 @@
+8388607
+8388608
+123456789012345678901234567890
+(+ 1 2)
+35184372088831
+(list 1 99999999999999999999 3)
+(list 1 (list 2 99999999999999999999) 3) (+ 4 5)
+(list 1 2 3)
@@ -0,0 +1,14 @@
+(define (f) (if #f (/ 1 0) 1))
+(f)
+(/ 7 0)
+(/ 12 3)
+(define (k) 5)
+(define (m) (k))
+(m)
+(set! k (lambda () 6))
+(m)
+(define g 1)
+(define (h) (set! g (+ g 1)) g)
+(h)
+(let ((g 10)) (set! g 20) g)
+g
@@ -0,0 +1,26 @@
+(define out (open-output-file "ports.txt"))
+out
+(write-string "first line
+second" out)
+(close-port out)
+(write-string "closed" out)
+(define in (open-input-file "ports.txt"))
+in
+(read-line in)
+(read-line in)
+(read-line in)
+(close-port in)
+(write-string "to standard output
+")
+(define s (open-output-string))
+(write-string "abc" s)
+(write-string "def" s)
+(get-output-string s)
+(write-string s "abc")
+(write-string "abc" 'port)
+(define (open-many n) (if (= n 0) 'opened (begin (open-input-file "ports.txt") (open-many (- n 1)))))
+(define (rounds n) (if (= n 0) 'done (begin (open-many 500) (gc) (rounds (- n 1)))))
+(rounds 8)
+(define kept (open-input-file "ports.txt"))
+(gc)
+(read-line kept)
@@ -0,0 +1,29 @@
+(define n 0)
+(define p (delay (begin (set! n (+ n 1)) (* 6 7))))
+n
+(force p)
+(force p)
+n
+(force 5)
+(define (integers k) (cons-stream k (integers (+ k 1))))
+(define (stream-ref s k) (if (= k 0) (stream-car s) (stream-ref (stream-cdr s) (- k 1))))
+(define nat (integers 0))
+(stream-ref nat 100)
+(stream-ref nat 100)
+(define (stream-map2 f s) (cons-stream (f (stream-car s)) (stream-map2 f (stream-cdr s))))
+(define squares (stream-map2 (lambda (x) (* x x)) nat))
+(list (stream-car squares) (stream-ref squares 5) (stream-ref squares 12))
+(define evals 0)
+(define (counted k) (cons-stream k (begin (set! evals (+ evals 1)) (counted (+ k 1)))))
+(define s (counted 0))
+(stream-ref s 50)
+(gc)
+(stream-ref s 50)
+evals
+(define failing (delay (car 1)))
+(force failing)
+(force failing)
+(force)
+(stream-car 1)
+(stream-cdr '())
+(stream-ref (integers 0) 3000)
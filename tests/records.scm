@@ -0,0 +1,22 @@
+(define-record-type point (make-point x y) point? (x point-x set-point-x!) (y point-y set-point-y!))
+(define-record-type node (make-node value next) node? (value node-value) (next node-next set-node-next!))
+(define p (make-point 3 4))
+p
+(list (point-x p) (point-y p) (point? p) (point? 5) (point? (make-node 1 '())))
+(set-point-x! p 10)
+(point-x p)
+(define (chain k acc) (if (= k 0) acc (chain (- k 1) (make-node k acc))))
+(define c (chain 1000 '()))
+(gc)
+(define (sum-nodes n acc) (if (null? n) acc (sum-nodes (node-next n) (+ acc (node-value n)))))
+(sum-nodes c 0)
+(list (point-x p) (point-y p))
+(point-x (make-node 1 2))
+(point-x 5)
+(set-point-y! c 1)
+(make-point 1)
+(make-point 1 2 3)
+(point-x)
+(set-node-next! c)
+(node? (make-node p p))
+(point-x (node-value (make-node p p)))
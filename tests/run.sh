@@ -0,0 +1,65 @@
+#!/bin/sh
+# Regression tests: builds the interpreter with the documented command, the library liblisp.a
+# from every object but main.o, the embedding test linked with it, and the shared object
+# tests/extension.scm loads. Then runs each tests/*.scm through the REPL and compares its
+# output with the .out file.
+# Files in tests/load are copied to the build directory, the REPL runs there, so load
+# finds them and writes its fasl caches outside the tree.
+# Usage: tests/run.sh [build-dir]  (a temporary directory by default)
+# A tests/name.args file holds command line flags for the REPL running tests/name.scm.
+# Tests run in name order, so image_load.scm maps the image image.scm saved.
+# Object ids are masked in the output: "Type: 13, ID: 231" reads "Type: 13, ID".
+# An interpreter built with -DLISP_NAN_BOXING runs the tests in nan_tests again in
+# build-dir/nan, against tests/name.nan.out where its output differs.
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+build=${1:-$(mktemp -d)}
+mkdir -p "$build" || exit 2
+build=$(cd "$build" && pwd)
+cxx=${CXX:-g++}
+flags="-std=c++17 -Wall -pthread"
+nan_tests="numbers large image image_load"
+
+cd "$root" || exit 2
+for source in *.cpp tests/embed_test.cpp; do
+    $cxx $flags -I"$root" -c "$source" -o "$build/$(basename "$source" .cpp).o" || exit 1
+done
+objects=$(ls *.cpp | grep -v '^main\.cpp$' | sed "s|^\(.*\)\.cpp$|$build/\1.o|")
+$cxx $flags $objects "$build/main.o" -ldl -rdynamic -o "$build/lisp" || exit 1
+rm -f "$build/liblisp.a"
+ar rcs "$build/liblisp.a" $objects || exit 1
+$cxx $flags "$build/embed_test.o" -L"$build" -llisp -ldl -rdynamic -o "$build/embed_test" || exit 1
+$cxx $flags -I"$root" -fPIC -shared tests/extension_test.cpp -o "$build/extension_test.so" || exit 1
+mkdir -p "$build/nan" || exit 2
+$cxx $flags -DLISP_NAN_BOXING *.cpp -ldl -rdynamic -o "$build/nan/lisp" || exit 1
+rm -f "$build"/*.fasl "$build"/*.img "$build"/nan/*.img
+cp tests/load/* "$build/"
+
+failed=0
+run_test() # run_test dir test expected
+{
+    args=$(cat "${2%.scm}.args" 2>/dev/null)
+    (cd "$1" && ./lisp $args < "$root/$2" 2>&1) | sed 's/ID: [0-9]*/ID/g' > "$build/output"
+    if cmp -s "$build/output" "$3"; then
+        echo "ok $2${4:+ ($4)}"
+    else
+        echo "FAIL $2${4:+ ($4)}"
+        diff "$3" "$build/output" | head -20
+        failed=1
+    fi
+}
+for test in tests/*.scm; do
+    run_test "$build" "$test" "${test%.scm}.out"
+done
+for name in $nan_tests; do
+    expected=tests/$name.nan.out
+    [ -f "$expected" ] || expected=tests/$name.out
+    run_test "$build/nan" "tests/$name.scm" "$expected" nan-boxing
+done
+if (cd "$build" && ./embed_test); then
+    echo "ok tests/embed_test.cpp"
+else
+    echo "FAIL tests/embed_test.cpp"
+    failed=1
+fi
+exit $failed
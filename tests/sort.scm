@@ -0,0 +1,30 @@
+(sort '(3 1 2 5 4) <)
+(sort '(3 1 2 5 4) >)
+(sort '() <)
+(sort '(1) <)
+(define pairs '((b . 2) (a . 1) (c . 2) (d . 1) (e . 2) (f . 1)))
+(sort pairs (lambda (x y) (< (cdr x) (cdr y))))
+(sort pairs (lambda (x y) (> (cdr x) (cdr y))))
+pairs
+(define v (make-vector 6 0))
+(define (fill-v k) (if (= k 6) v (begin (vector-set! v k (list-ref pairs k)) (fill-v (+ k 1)))))
+(fill-v 0)
+(define sorted-v (sort v (lambda (x y) (< (cdr x) (cdr y)))))
+(list (vector-ref sorted-v 0) (vector-ref sorted-v 5) (vector-ref v 0))
+(sort! v (lambda (x y) (< (cdr x) (cdr y))))
+(list (vector-ref v 0) (vector-ref v 1) (vector-ref v 2) (vector-ref v 3) (vector-ref v 4) (vector-ref v 5))
+(define l (list 5 3 9 1 7))
+(define head l)
+(define sorted-l (sort! l <))
+sorted-l
+(eq? (list-tail sorted-l 2) head)
+(define (descending k acc) (if (= k 0) acc (descending (- k 1) (cons (- 5000 k) acc))))
+(define big-holder (make-vector 1 (descending 3000 '())))
+(define (ordered? l) (if (null? (cdr l)) #t (if (> (car l) (car (cdr l))) #f (ordered? (cdr l)))))
+(define calls 0)
+(ordered? (sort (vector-ref big-holder 0) (lambda (x y) (set! calls (+ calls 1)) (< x y))))
+(< calls 40000)
+(ordered? (sort! (vector-ref big-holder 0) <))
+(sort '(1 2) 5)
+(sort 5 <)
+(sort '(2 1 3) (lambda (x y) (car x)))
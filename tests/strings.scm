@@ -0,0 +1,21 @@
+(define big #f)
+(define slice #f)
+(define inner #f)
+(begin (set! big (make-byte-string 20000 97)) (set! slice (substring big 100 10100)) (set! inner (substring slice 10 9010)) 'sliced)
+(string-byte-set! big 110 98)
+(list (string-byte-ref big 110) (string-byte-ref slice 10) (string-byte-ref inner 0))
+(string-byte-set! slice 10 99)
+(list (string-byte-ref big 110) (string-byte-ref slice 10) (string-byte-ref inner 0))
+(string-byte-set! inner 1 100)
+(list (string-byte-ref big 111) (string-byte-ref slice 11) (string-byte-ref inner 1))
+(define big2 #f)
+(define slices #f)
+(begin (set! big2 (make-byte-string 30000 120)) (set! slices (map (lambda (n) (substring big2 n (+ n 9000))) (list 0 1 2))) 'sliced)
+(string-byte-set! big2 5 121)
+(gc)
+(map (lambda (s) (string-byte-ref s 3)) slices)
+(string-byte-ref big2 5)
+(string-byte-set! (car slices) 3 122)
+(map (lambda (s) (string-byte-ref s 3)) slices)
+(begin (set! big2 #f) (set! slices (cdr slices)) (gc) (make-byte-string 9000 0) (gc) (length slices))
+(map (lambda (s) (string-byte-ref s 3)) slices)
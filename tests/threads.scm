@@ -0,0 +1,29 @@
+(define c (make-channel))
+(define (producer n) (if (= n 0) (channel-send c 'done) (begin (channel-send c n) (producer (- n 1)))))
+(define (consume acc) (let ((x (channel-receive c))) (if (eq? x 'done) acc (consume (+ acc x)))))
+(define t (spawn (lambda () (producer 100))))
+(consume 0)
+(join t)
+(define (count n) (if (= n 0) 'counted (begin (yield) (count (- n 1)))))
+(define t1 (spawn (lambda () (count 50))))
+(define t2 (spawn (lambda () (car 1))))
+(join t1)
+(join t2)
+(channel-receive c)
+(define (spawn-many n acc) (if (= n 0) acc (spawn-many (- n 1) (+ acc (join (spawn (lambda () n)))))))
+(spawn-many 500 0)
+(join t1)
+(join t2)
+t1
+(define (channels n) (if (= n 0) 'dropped (begin (channel-send (make-channel) n) (channels (- n 1)))))
+(channels 2000)
+(gc)
+(define c2 (make-channel))
+(define waiter (spawn (lambda () (+ (channel-receive c2) (channel-receive c2)))))
+(gc)
+(channel-send c2 40)
+(channel-send c2 2)
+(join waiter)
+(channel-send c 1)
+(channel-send c 2)
+(list (channel-receive c) (channel-receive c))
@@ -0,0 +1,356 @@
+//Green threads: many evaluations sharing one isolate, switched by a round-robin scheduler
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <vector>
+#include "lisp.hpp"
+
+/*
+    A thread has its own registers, a segment of the Lisp stack and a C++ stack for the
+    recursive evaluator. A switch saves the registers and the stack pointer of the current
+    thread, loads those of the next one and swaps the machine context.
+    eval and the allocators spend quantum_left, the current thread is preempted at the next
+    eval step once it is spent. A thread waiting on join or on a channel is blocked until
+    another thread sends or finishes, or on a descriptor until the event loop sees it ready.
+    When no thread can run and no descriptor is watched, the waiting one gets an error.
+    Thread 0 is the evaluation that spawned the first thread, it has the first segment.
+    Threads run while the REPL evaluates, not while it reads.
+    preempt and wait_until are the safepoints checking the limits, see safepoint.cpp.
+
+    A thread is a cell: (slot . generation) while it runs, (#t . value) or (#f . error) once done.
+    Its record in green_threads is reused after its machine stack is reaped, the generation
+    tells a reused slot from the old one. Errors are message literals, kept in thread_errors.
+    A channel is a cell (first link . last link) of a queue in the heap, so the collector frees
+    unreachable ones.
+*/
+
+const size_t thread_stack_bytes = 1 << 20;
+
+struct green_thread
+{
+    ucontext_t context;
+    void* machine_stack; //nullptr for thread 0
+    unsigned segment;
+    unsigned saved_pointer;
+    lisp_object registers[6]; //val, expr, argl, proc, unev, env
+    lisp_object thunk, handle; //handle is the thread cell while it runs
+    unsigned generation;
+    bool done, blocked;
+};
+
+thread_local std::vector<green_thread*> green_threads;
+thread_local std::vector<unsigned> free_threads; //Reaped records
+thread_local std::vector<unsigned> free_segments;
+thread_local std::vector<const char*> thread_errors;
+thread_local unsigned current_thread = 0;
+thread_local unsigned live_threads = 1;
+thread_local int thread_quantum = 10000;
+thread_local int quantum_left = 10000;
+
+void save_registers(green_thread& thread)
+{
+    lisp_object* registers = thread.registers;
+    registers[0] = val;
+    registers[1] = expr;
+    registers[2] = argl;
+    registers[3] = proc;
+    registers[4] = unev;
+    registers[5] = env;
+    thread.saved_pointer = stack_pointer;
+}
+
+void load_registers(const green_thread& thread)
+{
+    const lisp_object* registers = thread.registers;
+    val = registers[0];
+    expr = registers[1];
+    argl = registers[2];
+    proc = registers[3];
+    unev = registers[4];
+    env = registers[5];
+    stack_pointer = thread.saved_pointer;
+    stack_base = thread.segment*stack_size;
+    stack_limit = stack_base + stack_size;
+}
+
+void reap_threads(void) //Machine stacks of finished threads, never the running one. Their records are reused
+{
+    for(unsigned i = 0;i < green_threads.size();++i) {
+        green_thread& thread = *green_threads[i];
+        if(thread.done && thread.machine_stack && i != current_thread) {
+            munmap(thread.machine_stack,thread_stack_bytes);
+            thread.machine_stack = nullptr;
+            ++thread.generation;
+            free_threads.push_back(i);
+        }
+    }
+}
+
+int next_runnable(void) //Round robin from the current thread, -1 if no other can run
+{
+    for(unsigned step = 1;step < green_threads.size();++step) {
+        const unsigned i = (current_thread + step) % green_threads.size();
+        if(!green_threads[i]->done && !green_threads[i]->blocked)
+            return i;
+    }
+    return -1;
+}
+
+void switch_thread(unsigned next)
+{
+    green_thread& from = *green_threads[current_thread];
+    save_registers(from);
+    load_registers(*green_threads[next]);
+    current_thread = next;
+    quantum_left = thread_quantum;
+    swapcontext(&from.context,&green_threads[next]->context);
+    reap_threads();
+}
+
+void wake_threads(void)
+{
+    for(green_thread* thread : green_threads)
+        thread->blocked = false;
+}
+
+void wake_thread(unsigned id)
+{
+    if(id < green_threads.size())
+        green_threads[id]->blocked = false;
+}
+
+unsigned running_thread(void)
+{
+    return current_thread;
+}
+
+void set_blocked(bool blocked)
+{
+    if(!green_threads.empty())
+        green_threads[current_thread]->blocked = blocked;
+}
+
+void wait_until(const std::function<bool()>& ready,const char* deadlock) //Blocks the current thread until ready()
+{
+    while(!ready()) {
+        check_limits();
+        set_blocked(true);
+        const int next = next_runnable();
+        if(next != -1) {
+            switch_thread(next);
+        } else if(!poll_descriptors(limits_timeout())) {
+            set_blocked(false);
+            throw SimpleError(deadlock);
+        }
+    }
+    set_blocked(false);
+}
+
+void preempt(void)
+{
+    quantum_left = thread_quantum;
+    check_limits();
+    if(live_threads == 1)
+        return;
+    poll_descriptors(0); //Threads waiting on descriptors become runnable
+    const int next = next_runnable();
+    if(next != -1) {
+        switch_thread(next);
+        check_limits(); //Reached while the others ran
+    }
+}
+
+void stop_threads(void) //Thread 0 runs the others until a limit stops them at their safepoint
+{
+    if(current_thread != 0)
+        return;
+    while(live_threads > 1) {
+        wake_threads();
+        const int next = next_runnable();
+        if(next == -1)
+            break;
+        switch_thread(next);
+    }
+}
+
+unsigned thread_error_index(const char* error)
+{
+    const unsigned index = std::find(thread_errors.begin(),thread_errors.end(),error) - thread_errors.begin();
+    if(index == thread_errors.size())
+        thread_errors.push_back(error);
+    return index;
+}
+
+void thread_main(void)
+{
+    green_thread& self = *green_threads[current_thread];
+    lisp_object result = nil;
+    const char* error = nullptr;
+    try {
+        proc = self.thunk;
+        push(unev); //apply_procedure pops it
+        apply_procedure(0);
+        result = val;
+    } catch(SimpleError& err) {
+        error = err.what();
+    } catch(...) {
+        error = "spawn: evaluation failed";
+    }
+    set_car(self.handle.id,error ? val_false : val_true); //No allocation since result was taken
+    set_cdr(self.handle.id,error ? number(thread_error_index(error)) : result);
+    self.done = true;
+    self.thunk = self.handle = nil;
+    --live_threads;
+    free_segments.push_back(self.segment);
+    wake_threads();
+    const int next = next_runnable(); //Thread 0 never finishes
+    load_registers(*green_threads[next]);
+    current_thread = next;
+    quantum_left = thread_quantum;
+    setcontext(&green_threads[next]->context);
+}
+
+void gc_trace_threads(void) //The current thread is traced from the registers
+{
+    for(unsigned i = 0;i < green_threads.size();++i) {
+        green_thread& thread = *green_threads[i];
+        if(thread.done)
+            continue;
+        thread.thunk = gc_trace(thread.thunk);
+        thread.handle = gc_trace(thread.handle);
+        if(i == current_thread)
+            continue;
+        for(lisp_object& reg : thread.registers)
+            reg = gc_trace(reg);
+        for(unsigned j = thread.segment*stack_size;j < thread.saved_pointer;++j)
+            stack[j] = gc_trace(stack[j]);
+    }
+}
+
+bool pendingp(lisp_object thread) //Its cell still names a slot
+{
+    return typep(car(thread.id),fixnum);
+}
+
+//Primitives
+
+void prim_spawn(unsigned num) //(spawn thunk) starts a thread, it runs at the next switch
+{
+    if(num != 1 || !(typep(stack_get(0),compound) || typep(stack_get(0),primitive)))
+        throw SimpleError("spawn: procedure of no args awaited");
+    if(green_threads.empty()) {
+        green_threads.push_back(new green_thread{});
+        green_threads[0]->thunk = green_threads[0]->handle = nil;
+        for(unsigned segment = stack_segments - 1;segment > 0;--segment)
+            free_segments.push_back(segment);
+    }
+    reap_threads();
+    if(free_segments.empty())
+        throw SimpleError("spawn: too many threads");
+    val = make_obj(thread,cons(nil,nil).id);
+    void* machine_stack = mmap(nullptr,thread_stack_bytes,PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,-1,0);
+    if(machine_stack == MAP_FAILED)
+        throw SimpleError("spawn: cannot allocate a thread stack");
+
+    if(free_threads.empty()) {
+        green_threads.push_back(new green_thread{});
+        free_threads.push_back(green_threads.size() - 1);
+    }
+    const unsigned slot = free_threads.back();
+    free_threads.pop_back();
+    green_thread* thread = green_threads[slot];
+    const unsigned generation = thread->generation;
+    *thread = green_thread{};
+    thread->generation = generation;
+    thread->machine_stack = machine_stack;
+    thread->segment = free_segments.back();
+    free_segments.pop_back();
+    thread->saved_pointer = thread->segment*stack_size;
+    for(lisp_object& reg : thread->registers)
+        reg = nil;
+    thread->registers[5] = global_environment;
+    thread->thunk = stack_get(0);
+    thread->handle = val;
+    set_car(val.id,number(slot));
+    set_cdr(val.id,number(generation));
+    getcontext(&thread->context);
+    thread->context.uc_stack.ss_sp = machine_stack;
+    thread->context.uc_stack.ss_size = thread_stack_bytes;
+    thread->context.uc_link = nullptr;
+    makecontext(&thread->context,thread_main,0);
+    ++live_threads;
+}
+
+void prim_yield(unsigned num)
+{
+    if(num != 0)
+        throw SimpleError("yield: no args awaited");
+    preempt();
+    val = nil;
+}
+
+void prim_join(unsigned num) //(join thread) waits for its value, its error is raised again
+{
+    if(num != 1 || !typep(stack_get(0),thread))
+        throw SimpleError("join: thread awaited");
+    if(pendingp(stack_get(0))) {
+        const unsigned slot = car(stack_get(0).id).id;
+        if(slot >= green_threads.size() || !eq(cdr(stack_get(0).id),number(green_threads[slot]->generation)))
+            throw SimpleError("join: thread of another isolate");
+        if(slot == current_thread)
+            throw SimpleError("join: a thread cannot join itself");
+        wait_until([]{return !pendingp(stack_get(0));},"join: no thread can run"); //The cell may move meanwhile
+    }
+    const lisp_object obj = stack_get(0);
+    if(eq(car(obj.id),val_false)) {
+        check_limits(); //It may have been stopped by one
+        throw SimpleError(thread_errors[cdr(obj.id).id]);
+    }
+    val = cdr(obj.id);
+}
+
+void prim_make_channel(unsigned num)
+{
+    if(num != 0)
+        throw SimpleError("make-channel: no args awaited");
+    val = make_obj(channel,cons(nil,nil).id);
+}
+
+void prim_channel_send(unsigned num) //Channels are unbounded, sending never blocks
+{
+    if(num != 2)
+        throw SimpleError("channel-send: channel and value awaited");
+    if(!typep(stack_get(1),channel))
+        throw SimpleError("channel-send: channel awaited");
+    const lisp_object link = cons(stack_get(0),nil);
+    const lisp_object queue = stack_get(1); //After cons, which may move it
+    if(null(car(queue.id)))
+        set_car(queue.id,link);
+    else
+        set_cdr(cdr(queue.id).id,link);
+    set_cdr(queue.id,link);
+    wake_threads();
+    val = stack_get(0);
+}
+
+void prim_channel_receive(unsigned num) //Blocks until a value is sent
+{
+    if(num != 1 || !typep(stack_get(0),channel))
+        throw SimpleError("channel-receive: channel awaited");
+    wait_until([]{return !null(car(stack_get(0).id));},"channel-receive: no thread can send");
+    const lisp_object queue = stack_get(0);
+    const lisp_object first = car(queue.id);
+    val = car(first.id);
+    set_car(queue.id,cdr(first.id));
+    if(null(car(queue.id)))
+        set_cdr(queue.id,nil);
+}
+
+void prim_thread_quantum(unsigned num) //(thread-quantum n) sets the steps between switches
+{
+    if(num != 1 || !typep(stack_get(0),fixnum) || stack_get(0).id == 0 || (stack_get(0).id & fixnum_negative_flag))
+        throw SimpleError("thread-quantum: positive fixnum awaited");
+    val = number(static_cast<int>(thread_quantum));
+    thread_quantum = quantum_left = stack_get(0).id;
+}